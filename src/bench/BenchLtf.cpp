@@ -0,0 +1,959 @@
+// benchmarks for the localization path
+// usage: space_bench_ltf [options] [work dir]
+// synthetic .ltf files are generated into the work dir (temp dir by default).
+// every case is run and logged, then the report (see Report) on a generated corpus. options:
+//   --json <file>              only run the report and also write it to the file as JSON
+//   --ids <n>, --langs <n>, --words <n>, --seed <n>,
+//   --variations <share>, --inserts <share>, --multiline <share>,
+//   --comments <share>, --block-comments <share>
+//                              shape of the report corpus, shares are from 0 to 1 (see CorpusConfig)
+
+#include "../core/Config.h"
+#include "../core/Logging.h"
+#include "../core/Ltf.h"
+#include "../core/FlatMap.h"
+#include "../core/Rcu.h"
+#include "../engine/Localization.h"
+
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <charconv>
+#include <regex>
+#include <new>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+    #include <sys/resource.h>
+#elif defined(_WIN32)
+    #include <malloc.h>
+#endif
+
+// every allocation of the process is counted (each form of operator new), so cases can tell how many they make
+namespace bench
+{
+    inline std::atomic<size_t> allocations = 0;
+    inline std::atomic<size_t> allocatedBytes = 0;
+
+    inline void* Allocate(std::size_t size, std::size_t align = 0) noexcept
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        if (align == 0) return std::malloc(size ? size : 1);
+    #if defined(_WIN32)
+        return _aligned_malloc(size ? size : 1, align);
+    #else
+        return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+    #endif
+    }
+
+    inline void* AllocateOrThrow(std::size_t size, std::size_t align = 0)
+    {
+        if (void* ptr = Allocate(size, align)) return ptr;
+        throw std::bad_alloc();
+    }
+
+    inline void Free(void* ptr) noexcept                    { std::free(ptr); }
+
+    inline void FreeAligned(void* ptr) noexcept
+    {
+    #if defined(_WIN32)
+        _aligned_free(ptr);
+    #else
+        std::free(ptr);
+    #endif
+    }
+}
+
+void* operator new(std::size_t size)                                                    { return bench::AllocateOrThrow(size); }
+void* operator new[](std::size_t size)                                                  { return bench::AllocateOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept                    { return bench::Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept                  { return bench::Allocate(size); }
+void* operator new(std::size_t size, std::align_val_t align)                            { return bench::AllocateOrThrow(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align)                          { return bench::AllocateOrThrow(size, static_cast<std::size_t>(align)); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept    { return bench::Allocate(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept  { return bench::Allocate(size, static_cast<std::size_t>(align)); }
+
+void operator delete(void* ptr) noexcept                                                { bench::Free(ptr); }
+void operator delete[](void* ptr) noexcept                                              { bench::Free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                                   { bench::Free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept                                 { bench::Free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept                         { bench::Free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept                       { bench::Free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept                              { bench::FreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept                            { bench::FreeAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept                 { bench::FreeAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept               { bench::FreeAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept       { bench::FreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept     { bench::FreeAligned(ptr); }
+
+namespace bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double Seconds(Clock::time_point begin, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    // shape of a generated .ltf file. the same config and seed always give the same file
+    struct CorpusConfig
+    {
+        size_t      ids = 10'000;
+        size_t      langs = 5;              // up to 10
+        size_t      words = 12;             // per text
+        double      variations = 0;         // share of texts that also have a ".mult" variation
+        double      inserts = 0;            // share of texts with an argument and a reference to an earlier id
+        double      multiline = 0;          // share of texts spread over several lines
+        double      comments = 1;           // share of entries with a comment before them
+        double      blockComments = 0;      // share of those comments that are /* */ blocks over two lines
+        uint64_t    seed = 0;
+    };
+
+    // writes a file with "config.ids" entries, ids are "<file name>_<index>"
+    inline void GenerateLtf(const std::filesystem::path& path, const CorpusConfig& config)
+    {
+        static constexpr const char* codes[] = { "en", "ru", "ja", "zh", "es", "ar", "de", "pt", "fr", "hi" };
+        static constexpr const char* words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit" };
+
+        // words and the shape of the file come from separate streams, so enabling a feature keeps the words
+        uint64_t state = config.seed;
+        uint64_t shape = util::Mix64(config.seed ^ 0x5BD1E995);
+        auto chance = [&](double share)
+            {
+                if (share <= 0) return false;
+                shape = util::Mix64(shape + 1);
+                return double(shape >> 11) * 0x1.0p-53 < share;
+            };
+
+        const std::string stem = path.stem().string();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (size_t id = 0; id < config.ids; ++id)
+        {
+            if (chance(config.comments))
+            {
+                if (chance(config.blockComments)) out << "/* entry " << id << "\n   " << words[id % std::size(words)] << " */\n";
+                else out << "// entry " << id << "\n";
+            }
+            out << '[' << stem << "_" << id << "]\n";
+
+            for (size_t ln = 0; ln < config.langs && ln < std::size(codes); ++ln)
+            {
+                auto text = [&]()
+                    {
+                        const bool multiline = chance(config.multiline);
+                        const bool inserts = id > 0 && chance(config.inserts);
+                        for (size_t w = 0; w < config.words; ++w)
+                        {
+                            state = util::Mix64(state + 1);
+                            out << words[state % std::size(words)] << ' ';
+                            if (multiline && w % 4 == 3 && w + 1 < config.words) out << (w % 8 == 3 ? "\\\n" : "\n");
+                            if (inserts && w == config.words / 2)
+                                out << "{} {" << stem << '_' << shape % id << (shape & 1 ? ".mult" : "") << "} ";
+                        }
+                        out << '\n';
+                    };
+
+                out << '[' << codes[ln] << "] ";
+                text();
+                if (chance(config.variations))
+                {
+                    out << '[' << codes[ln] << ".mult] ";
+                    text();
+                }
+            }
+        }
+    }
+
+    // "ids" entries with a comment each, translated into "langs" languages
+    inline void GenerateLtf(const std::filesystem::path& path, size_t ids, size_t langs, uint64_t seed)
+    {
+        GenerateLtf(path, CorpusConfig{ .ids = ids, .langs = langs, .seed = seed });
+    }
+
+    // LoadFiles over many files with 1..N threads
+    inline void LoadScaling(const std::filesystem::path& dir)
+    {
+        constexpr size_t FILES = 48;
+        std::vector<std::filesystem::path> paths;
+        size_t bytes = 0;
+        for (size_t i = 0; i < FILES; ++i)
+        {
+            paths.push_back(dir / std::format("table{}.ltf", i));
+            GenerateLtf(paths.back(), 5000, 5, i);
+            bytes += std::filesystem::file_size(paths.back());
+        }
+
+        lg::Info(std::format("LoadFiles: {} files, {:.1f} MB", FILES, bytes / 1e6));
+        double single = 0;
+        for (size_t threads = 1; threads <= util::GetThreadCount(); threads *= 2)
+        {
+            eng::loc::Localization loc;
+            loc.SetLoadThreads(threads);
+
+            auto begin = Clock::now();
+            loc.LoadFiles(paths);
+            double time = Seconds(begin, Clock::now());
+            if (threads == 1) single = time;
+
+            lg::Info(std::format("  threads: {:3}  time: {:8.1f} ms  {:8.1f} MB/s  speedup: {:.2f}x",
+                threads, time * 1e3, bytes / 1e6 / time, single / time));
+        }
+
+        for (const auto& path : paths) std::filesystem::remove(path);
+    }
+
+    // lookups with the language switched every frame: per-entry map (old path) vs dense per-language tables
+    inline void LanguageSwitch(const std::filesystem::path& dir)
+    {
+        constexpr size_t IDS = 20000;
+        constexpr size_t LANGS = 5;
+        constexpr size_t FRAMES = 200;
+        constexpr size_t LOOKUPS_PER_FRAME = 5000;
+        static constexpr lang::Language langs[] = { lang::Language::ENGLISH, lang::Language::RUSSIAN, lang::Language::JAPANESE, lang::Language::CHINESE, lang::Language::SPANISH };
+
+        auto path = dir / "switch.ltf";
+        GenerateLtf(path, IDS, LANGS, 42);
+
+        std::vector<std::string> tags;
+        std::vector<eng::loc::TagKey> keys;
+        uint64_t state = 7;
+        for (size_t i = 0; i < LOOKUPS_PER_FRAME; ++i)
+        {
+            state = util::Mix64(state);
+            tags.push_back(std::format("switch_{}", state % IDS));
+            keys.push_back(eng::loc::TagKey::FromString(tags.back()));
+        }
+
+        file::LtfFile file;
+        file.Prepare(path);
+        file.CreateMapAll();
+        const auto& map = file.GetMap();
+
+        size_t checksum = 0;
+        auto begin = Clock::now();
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+        {
+            lang::Language lan = langs[frame % LANGS];
+            for (const auto& tag : tags)
+            {
+                checksum += map.at(tag).Find(lan)->size();
+            }
+        }
+        double mapTime = Seconds(begin, Clock::now());
+
+        eng::loc::Localization loc;
+        loc.LoadFiles({ path });
+
+        begin = Clock::now();
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+        {
+            loc.SetLanguage(langs[frame % LANGS]);
+            for (auto key : keys) checksum -= loc.GetStrView(key).size();
+        }
+        double tableTime = Seconds(begin, Clock::now());
+        loc.SetLanguage(lang::Language::ENGLISH);
+
+        constexpr double LOOKUPS = double(FRAMES * LOOKUPS_PER_FRAME);
+        lg::Info(std::format("Language switch: {} ids, {} languages, {} lookups per frame", IDS, LANGS, LOOKUPS_PER_FRAME));
+        lg::Info(std::format("  entry map:     {:8.1f} ns/lookup", mapTime * 1e9 / LOOKUPS));
+        lg::Info(std::format("  string tables: {:8.1f} ns/lookup  ({:.2f}x){}", tableTime * 1e9 / LOOKUPS, mapTime / tableTime,
+            checksum == 0 ? "" : "  MISMATCH"));
+
+        std::filesystem::remove(path);
+    }
+
+    // checking a file through the mapping vs streaming it through a window: time and the memory the parser holds
+    inline void StreamingParse(const std::filesystem::path& dir)
+    {
+        lg::Info("Streaming parse (mapped / streamed):");
+        for (size_t ids : { 10'000, 100'000, 500'000 })
+        {
+            auto path = dir / "stream.ltf";
+            GenerateLtf(path, ids, 5, ids);
+            const size_t bytes = std::filesystem::file_size(path);
+
+            size_t mappedSlices = 0;
+            auto begin = Clock::now();
+            {
+                file::File src;
+                src.Open(path, file::FileMode::READ);
+                src.Map();
+                file::itrn::LtfReader reader(src.GetView());
+                reader.Parse([&](const file::itrn::LtfSlice&) { ++mappedSlices; });
+            }
+            double mapped = Seconds(begin, Clock::now());
+
+            size_t streamedSlices = 0;
+            file::itrn::LtfStreamReader reader(path);
+            begin = Clock::now();
+            reader.Parse([&](const file::itrn::LtfSlice&) { ++streamedSlices; });
+            double streamed = Seconds(begin, Clock::now());
+
+            lg::Info(std::format("  {:7.1f} MB  time: {:7.1f} / {:7.1f} ms  memory: {:7.1f} / {:5.1f} MB{}",
+                bytes / 1e6, mapped * 1e3, streamed * 1e3, bytes / 1e6, reader.GetPeakMemory() / 1e6,
+                mappedSlices == streamedSlices ? "" : "  MISMATCH"));
+            std::filesystem::remove(path);
+        }
+    }
+
+    // the same corpus parsed with every scanner the cpu supports, the slices have to match the scalar ones
+    inline void SimdScan(const std::filesystem::path& dir)
+    {
+        struct Slice
+        {
+            std::string id, var, text;
+            lang::Language lan;
+            size_t begin, end;
+            bool operator==(const Slice&) const = default;
+        };
+
+        auto path = dir / "simd.ltf";
+        GenerateLtf(path, { .ids = 50'000, .variations = 0.2, .inserts = 0.2, .multiline = 0.2, .comments = 0.5, .blockComments = 0.3, .seed = 5 });
+
+        file::File src;
+        src.Open(path, file::FileMode::READ);
+        src.Map();
+
+        const util::SimdLevel detected = util::GetSimdLevel();
+        std::vector<Slice> scalar;
+        lg::Info("SIMD scan (parse time, slices compared with the scalar parse):");
+        for (auto [level, name] : { std::pair{ util::SimdLevel::SCALAR, "scalar" }, { util::SimdLevel::SSE2, "SSE2" }, { util::SimdLevel::AVX2, "AVX2" } })
+        {
+            util::SetSimdLevel(level);
+            if (util::GetSimdLevel() != level)
+            {
+                lg::Info(std::format("  {:6}  not supported", name));
+                continue;
+            }
+
+            std::vector<Slice> slices;
+            auto begin = Clock::now();
+            file::itrn::LtfReader reader(src.GetView());
+            reader.Parse([&](const file::itrn::LtfSlice& s)
+                {
+                    slices.push_back({ std::string(s.id), std::string(s.var), std::string(s.text), s.lan, s.begin, s.end });
+                });
+            const double time = Seconds(begin, Clock::now());
+
+            if (level == util::SimdLevel::SCALAR) scalar = slices;
+            lg::Info(std::format("  {:6}  {:7.1f} ms  {} slices{}", name, time * 1e3, slices.size(), slices == scalar ? "" : "  MISMATCH"));
+        }
+        util::SetSimdLevel(detected);
+
+        src.Close();
+        std::filesystem::remove(path);
+    }
+
+    // reads per second of "read" (which returns true if what it read is right) on "threads" threads,
+    // while "write" is called in a loop on this one. mismatches are counted into "errors"
+    template<typename Read, typename Write>
+    inline double ReadThroughput(size_t threads, double seconds, std::atomic<size_t>& errors, Read&& read, Write&& write)
+    {
+        std::atomic<bool> stop = false;
+        std::atomic<size_t> reads = 0;
+        std::vector<std::jthread> readers;
+        for (size_t t = 0; t < threads; ++t)
+        {
+            readers.emplace_back([&, t]()
+                {
+                    size_t count = 0;
+                    for (uint64_t state = t; !stop.load(std::memory_order_relaxed); ++count)
+                    {
+                        state = util::Mix64(state);
+                        if (!read(state)) errors.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    reads += count;
+                });
+        }
+
+        auto begin = Clock::now();
+        while (Seconds(begin, Clock::now()) < seconds) write();
+        stop = true;
+        readers.clear();
+        return reads / Seconds(begin, Clock::now());
+    }
+
+    // lookups from several threads while the main thread keeps rewriting, loading and unloading a file.
+    // every string read has to be the whole text of its tag (text of a freed version shows up as garbage)
+    inline void ConcurrentReads(const std::filesystem::path& dir)
+    {
+        constexpr size_t IDS = 20000;
+        constexpr double SECONDS = 0.5;
+
+        auto path = dir / "concurrent.ltf";
+        auto write = [&](size_t version)
+            {
+                std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                for (size_t id = 0; id < IDS; ++id)
+                    out << "[concurrent_" << id << "]\n[en] concurrent_" << id << " version " << version % 10 << '\n';
+            };
+
+        std::vector<std::string> tags;
+        std::vector<eng::loc::TagKey> keys;
+        for (size_t id = 0; id < IDS; ++id)
+        {
+            tags.push_back(std::format("concurrent_{}", id));
+            keys.push_back(eng::loc::TagKey::FromString(tags.back()));
+        }
+
+        auto valid = [&](std::string_view text, size_t id)
+            {
+                if (text == file::itrn::MISSING_TRANSLATION) return true;
+                const std::string_view tag = tags[id];
+                return text.size() == tag.size() + 10 && text.starts_with(tag) && text.substr(tag.size(), 9) == " version ";
+            };
+
+        eng::loc::Localization loc;
+        loc.SetLanguage(lang::Language::ENGLISH);
+        write(0);
+        loc.LoadFiles({ path });
+
+        std::atomic<size_t> errors = 0;
+        size_t versions = 0;
+        auto writer = [&]()
+            {
+                loc.UnloadFilesAll();
+                write(++versions);
+                loc.LoadFiles({ path });
+            };
+
+        // odd threads keep a handle for a few lookups, even ones copy one string at a time
+        // (a view from GetStrView alone may already be freed by the writer when it's checked)
+        auto reader = [&](uint64_t state)
+            {
+                const size_t id = state % IDS;
+                if (state & 1)
+                {
+                    auto handle = loc.Read();
+                    std::string_view first = handle.GetStrView(keys[id]);
+                    std::string_view second = handle.GetStrView(keys[(id + 1) % IDS]);
+                    return valid(first, id) && valid(second, (id + 1) % IDS);
+                }
+                return valid(loc.GetStrByTag(keys[id]), id) && valid(loc.Format(keys[id]), id);
+            };
+
+        lg::Info(std::format("Concurrent reads: {} ids, reloaded by the main thread", IDS));
+        for (size_t threads = 1; threads <= std::max<size_t>(4, util::GetThreadCount()); threads *= 2)
+        {
+            versions = 0;
+            double idle = ReadThroughput(threads, SECONDS, errors, reader, []() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+            double busy = ReadThroughput(threads, SECONDS, errors, reader, writer);
+            lg::Info(std::format("  readers: {:3}  {:8.2f} M reads/s idle  {:8.2f} M reads/s while reloading ({} reloads)",
+                threads, idle / 1e6, busy / 1e6, versions));
+        }
+        if (errors) lg::Error(std::format("  {} reads returned broken text", errors.load()));
+
+        loc.UnloadFilesAll();
+        std::filesystem::remove(path);
+    }
+
+    // entering a read section: std::atomic<std::shared_ptr> (a lock and a shared reference count) vs util::Rcu
+    inline void SnapshotRead()
+    {
+        constexpr double SECONDS = 0.3;
+
+        std::atomic<std::shared_ptr<const uint64_t>> shared = std::make_shared<const uint64_t>(1);
+        util::Rcu<uint64_t> rcu(std::make_unique<const uint64_t>(1));
+        std::atomic<size_t> errors = 0;
+        auto idle = []() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); };
+
+        lg::Info("Snapshot reads:");
+        for (size_t threads = 1; threads <= std::max<size_t>(4, util::GetThreadCount()); threads *= 2)
+        {
+            double sharedReads = ReadThroughput(threads, SECONDS, errors, [&](uint64_t) { return *shared.load() == 1; }, idle);
+            double rcuReads = ReadThroughput(threads, SECONDS, errors, [&](uint64_t) { return *rcu.Read() == 1; }, idle);
+            lg::Info(std::format("  readers: {:3}  {:8.2f} / {:8.2f} M reads/s  (atomic<shared_ptr> / Rcu)  ({:.2f}x){}",
+                threads, sharedReads / 1e6, rcuReads / 1e6, rcuReads / sharedReads, errors ? "  MISMATCH" : ""));
+        }
+    }
+
+    // resident memory of the process, 0 where it isn't known
+    inline size_t ResidentBytes()
+    {
+    #if defined(__linux__)
+        size_t pages = 0, resident = 0;
+        if (FILE* statm = std::fopen("/proc/self/statm", "r"))
+        {
+            if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2) resident = 0;
+            std::fclose(statm);
+        }
+        return resident * 4096;
+    #else
+        return 0;
+    #endif
+    }
+
+    // highest resident memory the process had so far, 0 where it isn't known
+    inline size_t PeakResidentBytes()
+    {
+    #if defined(__linux__)
+        rusage usage{};
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<size_t>(usage.ru_maxrss) * 1024 : 0;
+    #else
+        return 0;
+    #endif
+    }
+
+    // random lookups in one language of a plain .ltfb vs block-compressed ones:
+    // file size, time per lookup and how much the process holds afterwards
+    inline void CompressedText(const std::filesystem::path& dir)
+    {
+        constexpr size_t IDS = 100'000;
+        constexpr size_t LOOKUPS = 200'000;
+
+        auto src = dir / "compressed.ltf";
+        auto dst = dir / "compressed.ltfb";
+        GenerateLtf(src, IDS, 10, 3);
+
+        std::vector<std::string> tags;
+        uint64_t state = 11;
+        for (size_t i = 0; i < LOOKUPS; ++i)
+        {
+            state = util::Mix64(state);
+            tags.push_back(std::format("compressed_{}", state % IDS));
+        }
+
+        struct Setup { uint32_t blockSize; size_t cacheBlocks; };
+        static constexpr Setup setups[] = { { 0, 0 }, { 4096, 16 }, { 16384, 1 }, { 16384, 16 }, { 16384, 256 }, { 65536, 16 } };
+
+        lg::Info(std::format("Compressed .ltfb: {} ids, 10 languages, {} random lookups in one language", IDS, LOOKUPS));
+        size_t plainChecksum = 0;
+        for (const auto& setup : setups)
+        {
+            if (!file::CompileLtfb(src, dst, setup.blockSize)) return;
+
+            const size_t residentBefore = ResidentBytes();
+            size_t checksum = 0;
+            double time = 0;
+            {
+                file::LtfBinFile bin;
+                bin.Prepare(dst, false);     // the checksum would page in the whole file
+                bin.SetCacheSize(setup.cacheBlocks);
+
+                auto begin = Clock::now();
+                for (const auto& tag : tags) checksum += bin.ReadText(bin.FindEntry(tag), lang::Language::ENGLISH)->size();
+                time = Seconds(begin, Clock::now());
+
+                const size_t resident = ResidentBytes() - std::min(residentBefore, ResidentBytes());
+                lg::Info(std::format("  {:14}  file: {:6.1f} MB  lookup: {:7.1f} ns  resident: {:6.1f} MB  decoded: {:5.1f} MB{}",
+                    setup.blockSize ? std::format("{} KB x{:<4}", setup.blockSize / 1024, setup.cacheBlocks) : std::string("plain"),
+                    std::filesystem::file_size(dst) / 1e6, time * 1e9 / LOOKUPS, resident / 1e6, bin.GetDecodedBytes() / 1e6,
+                    !setup.blockSize || checksum == plainChecksum ? "" : "  MISMATCH"));
+            }
+            if (!setup.blockSize) plainChecksum = checksum;
+        }
+
+        std::filesystem::remove(src);
+        std::filesystem::remove(dst);
+    }
+
+    // a screen full of tags resolved one call at a time vs one GetStrViews call, with tables larger than the LLC
+    inline void BatchLookup(const std::filesystem::path& dir)
+    {
+        constexpr size_t IDS = 1'000'000;
+        constexpr size_t SCREENS = 4000;
+        constexpr size_t TAGS_PER_SCREEN = 256;
+
+        auto path = dir / "batch.ltf";
+        GenerateLtf(path, IDS, 1, 5);
+
+        eng::loc::Localization loc;
+        loc.SetLanguage(lang::Language::ENGLISH);
+        loc.LoadFiles({ path });
+
+        std::vector<eng::loc::TagKey> keys;
+        uint64_t state = 13;
+        for (size_t i = 0; i < SCREENS * TAGS_PER_SCREEN; ++i)
+        {
+            state = util::Mix64(state);
+            keys.push_back(eng::loc::TagKey::FromString(std::format("batch_{}", state % IDS)));
+        }
+
+        size_t checksum = 0;
+        auto begin = Clock::now();
+        for (auto key : keys) checksum += loc.GetStrView(key).size();
+        double single = Seconds(begin, Clock::now());
+
+        begin = Clock::now();
+        for (size_t screen = 0; screen < SCREENS; ++screen)
+        {
+            auto handle = loc.Read();
+            for (size_t i = 0; i < TAGS_PER_SCREEN; ++i) checksum -= handle.GetStrView(keys[screen * TAGS_PER_SCREEN + i]).size();
+        }
+        double handle = Seconds(begin, Clock::now());
+
+        std::vector<std::string_view> out(TAGS_PER_SCREEN);
+        size_t batchChecksum = 0;
+        begin = Clock::now();
+        for (size_t screen = 0; screen < SCREENS; ++screen)
+        {
+            loc.GetStrViews(std::span(keys).subspan(screen * TAGS_PER_SCREEN, TAGS_PER_SCREEN), out);
+            for (auto text : out) batchChecksum += text.size();
+        }
+        double batch = Seconds(begin, Clock::now());
+
+        // checksum is 0 if the handle loop saw the same text as the single calls
+        constexpr double LOOKUPS = double(SCREENS * TAGS_PER_SCREEN);
+        lg::Info(std::format("Batch lookup: {} ids, {} screens of {} tags", IDS, SCREENS, TAGS_PER_SCREEN));
+        lg::Info(std::format("  GetStrView per tag:    {:7.1f} ns/tag", single * 1e9 / LOOKUPS));
+        lg::Info(std::format("  ReadHandle per screen: {:7.1f} ns/tag  ({:.2f}x)", handle * 1e9 / LOOKUPS, single / handle));
+        lg::Info(std::format("  GetStrViews:           {:7.1f} ns/tag  ({:.2f}x){}", batch * 1e9 / LOOKUPS, single / batch,
+            checksum == 0 && batchChecksum > 0 ? "" : "  MISMATCH"));
+
+        loc.UnloadFilesAll();
+        std::filesystem::remove(path);
+    }
+
+    // string_view lookups of localization ids: std::unordered_map (needs a temporary string) vs util::FlatMap
+    inline void MapLookup()
+    {
+        constexpr size_t LOOKUPS = 2'000'000;
+
+        lg::Info("Map lookup by string_view:");
+        for (size_t keys : { 10'000, 100'000, 1'000'000 })
+        {
+            std::vector<std::string> ids;
+            for (size_t i = 0; i < keys; ++i) ids.push_back(std::format("menu_item_description_{}", util::Mix64(i)));
+
+            std::vector<std::string_view> queries;
+            uint64_t state = keys;
+            for (size_t i = 0; i < LOOKUPS; ++i)
+            {
+                state = util::Mix64(state);
+                queries.push_back(ids[state % keys]);
+            }
+
+            std::unordered_map<std::string, uint32_t> stdMap;
+            util::FlatMap<std::string, uint32_t> flatMap;
+            auto begin = Clock::now();
+            for (uint32_t i = 0; i < keys; ++i) stdMap[ids[i]] = i;
+            double stdInsert = Seconds(begin, Clock::now());
+            begin = Clock::now();
+            for (uint32_t i = 0; i < keys; ++i) flatMap[ids[i]] = i;
+            double flatInsert = Seconds(begin, Clock::now());
+
+            size_t checksum = 0;
+            begin = Clock::now();
+            for (auto q : queries) checksum += stdMap.find(std::string(q))->second;
+            double stdFind = Seconds(begin, Clock::now());
+            begin = Clock::now();
+            for (auto q : queries) checksum -= flatMap.find(q)->second;
+            double flatFind = Seconds(begin, Clock::now());
+
+            lg::Info(std::format("  {:8} keys  insert: {:6.1f} / {:6.1f} ns  find: {:6.1f} / {:6.1f} ns  (unordered_map / FlatMap){}",
+                keys, stdInsert * 1e9 / keys, flatInsert * 1e9 / keys, stdFind * 1e9 / LOOKUPS, flatFind * 1e9 / LOOKUPS,
+                checksum == 0 ? "" : "  MISMATCH"));
+        }
+    }
+
+    // language header lookups: the compare chain that covered 10 codes vs the perfect hash over all of them
+    inline void LanguageCodes()
+    {
+        constexpr size_t LOOKUPS = 20'000'000;
+
+        auto chain = [](std::string_view code)
+            {
+                using lang::Language;
+                if (code == "en") return Language::ENGLISH;
+                else if (code == "ru") return Language::RUSSIAN;
+                else if (code == "ja") return Language::JAPANESE;
+                else if (code == "zh") return Language::CHINESE;
+                else if (code == "es") return Language::SPANISH;
+                else if (code == "ar") return Language::ARABIC;
+                else if (code == "de") return Language::GERMAN;
+                else if (code == "pt") return Language::PORTUGESE;
+                else if (code == "fr") return Language::FRENCH;
+                else if (code == "hi") return Language::HINDI;
+                else return Language::NONE;
+            };
+
+        // mostly the codes the chain knows, in a random order, and some it doesn't
+        std::vector<std::string_view> codes;
+        uint64_t state = 1;
+        for (size_t i = 0; i < 4096; ++i)
+        {
+            state = util::Mix64(state);
+            codes.push_back(lang::GetLanguageCode(static_cast<lang::Language>(1 + state % (i % 4 ? 10 : lang::LANGUAGE_COUNT - 1))));
+        }
+
+        size_t checksum = 0;
+        auto begin = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i) checksum += static_cast<size_t>(chain(codes[i % codes.size()]));
+        const double chainTime = Seconds(begin, Clock::now());
+        begin = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i)
+        {
+            // codes the chain doesn't know count as NONE, as they do there
+            const size_t lan = static_cast<size_t>(lang::GetLanguageCodeEnum(codes[i % codes.size()]));
+            checksum -= lan <= static_cast<size_t>(lang::Language::HINDI) ? lan : 0;
+        }
+        const double hashTime = Seconds(begin, Clock::now());
+
+        lg::Info(std::format("Language codes: {:.2f} / {:.2f} ns per lookup (compare chain over 10 / perfect hash over {}){}",
+            chainTime * 1e9 / LOOKUPS, hashTime * 1e9 / LOOKUPS, lang::LANGUAGE_COUNT - 1, checksum == 0 ? "" : "  MISMATCH"));
+    }
+
+    // ltf id and insert reference validation: the std::regex check it replaced vs the DFA. first the DFA is compared
+    // with the regex on every string of up to 2 bytes and on every string of up to 5 characters picked from
+    // each character class (and the edges between them), a mismatch is logged with the string
+    inline void IdValidation()
+    {
+        constexpr size_t LOOKUPS = 2'000'000;
+
+        const std::regex idRegex("^[A-Za-z0-9_-]+$");
+        auto regexId = [&](std::string_view id)
+            {
+                if (id.empty() || (id[0] >= '0' && id[0] <= '9')) return false;
+                if (lang::IsHeaderLanguage(lang::GetLanguageCodeEnum(id))) return false;
+                return std::regex_match(id.begin(), id.end(), idRegex);
+            };
+        auto regexRef = [&](std::string_view ref) { return regexId(ref.substr(0, ref.find('.'))) && ref.back() != '.'; };
+
+        size_t checked = 0, mismatches = 0;
+        auto check = [&](std::string_view str)
+            {
+                ++checked;
+                const bool id = file::itrn::CorrectLtfId(str) == regexId(str);
+                const bool ref = file::itrn::CorrectLtfRef(str) == regexRef(str);
+                if (id && ref) return;
+                if (++mismatches <= 10) lg::Error(std::format("Id validation mismatch ({}) on \"{}\"", id ? "reference" : "id", str));
+            };
+
+        std::string str;
+        check(str);
+        for (int a = 0; a < 256; ++a)
+        {
+            check(std::string(1, static_cast<char>(a)));
+            for (int b = 0; b < 256; ++b) check(std::string{ static_cast<char>(a), static_cast<char>(b) });
+        }
+        constexpr std::string_view ALPHABET = "aAzZ09_-./ :@[`{}\x7F\x80\xFF";     // language codes are made of letters, "en" included
+        std::vector<size_t> digits;
+        for (size_t length = 1; length <= 5; ++length)
+        {
+            digits.assign(length, 0);
+            for (;;)
+            {
+                str.clear();
+                for (size_t d : digits) str += ALPHABET[d];
+                check(str);
+
+                size_t d = 0;
+                while (d < length && ++digits[d] == ALPHABET.size()) digits[d++] = 0;
+                if (d == length) break;
+            }
+        }
+        for (std::string_view code : { "en", "pt-BR", "zh-Hant", "en.x", "pt-BR.formal", "ena", "xen", "no", "it.x" }) check(code);
+
+        std::vector<std::string> ids;
+        uint64_t state = 1;
+        for (size_t i = 0; i < 4096; ++i)
+        {
+            state = util::Mix64(state);
+            if (i % 4 == 3) ids.push_back(std::format("menu_item_{}.variation_{}", state % 1000, state % 7));
+            else ids.push_back(std::format("menu_item_description_{}", state % 100'000));
+        }
+
+        size_t accepted = 0;
+        auto begin = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i) accepted += regexRef(ids[i % ids.size()]);
+        const double regexTime = Seconds(begin, Clock::now());
+        begin = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i) accepted -= file::itrn::CorrectLtfRef(ids[i % ids.size()]);
+        const double dfaTime = Seconds(begin, Clock::now());
+
+        lg::Info(std::format("Id validation: {:.1f} / {:.1f} ns per reference (std::regex / DFA), {} strings compared{}",
+            regexTime * 1e9 / LOOKUPS, dfaTime * 1e9 / LOOKUPS, checked, mismatches == 0 && accepted == 0 ? "" : "  MISMATCH"));
+    }
+
+    // one generated corpus measured end to end: parse throughput, building the lookup tables on top of it,
+    // lookups with warm and with flushed caches, allocations and peak memory. the numbers are logged and,
+    // if "json" isn't empty, written there, so runs of different releases can be compared
+    inline void Report(const std::filesystem::path& dir, const CorpusConfig& config, const std::filesystem::path& json)
+    {
+        constexpr size_t RUNS = 3;                  // parse and load times are the best of these
+        constexpr size_t HOT_KEYS = 256;
+        constexpr size_t HOT_LOOKUPS = 2'000'000;
+        constexpr size_t COLD_ROUNDS = 64;
+        constexpr size_t COLD_LOOKUPS = 1024;       // per round, the caches are flushed before each one
+        constexpr size_t FLUSH_BYTES = 64 << 20;
+
+        auto path = dir / "report.ltf";
+        GenerateLtf(path, config);
+        const size_t bytes = std::filesystem::file_size(path);
+
+        // parsing into the map LoadFiles creates for .ltf files
+        double parse = 1e300;
+        size_t parseAllocs = 0;
+        for (size_t run = 0; run < RUNS; ++run)
+        {
+            const size_t allocs = allocations.load();
+            auto begin = Clock::now();
+            file::LtfFile file;
+            if (!file.Prepare(path) || !file.CreateMapAll()) throw exc::CoreException(std::format("Failed to parse {}", path.string()));
+            parse = std::min(parse, Seconds(begin, Clock::now()));
+            parseAllocs = allocations.load() - allocs;
+        }
+
+        // the same parse plus the tables lookups use, the difference is what building them costs
+        eng::loc::Localization loc;
+        loc.SetLanguage(lang::Language::ENGLISH);
+        double load = 1e300;
+        size_t loadAllocs = 0;
+        for (size_t run = 0; run < RUNS; ++run)
+        {
+            loc.UnloadFilesAll();
+            const size_t allocs = allocations.load();
+            auto begin = Clock::now();
+            loc.LoadFiles({ path });
+            load = std::min(load, Seconds(begin, Clock::now()));
+            loadAllocs = allocations.load() - allocs;
+        }
+
+        const std::string stem = path.stem().string();
+        auto key = [&](uint64_t id) { return eng::loc::TagKey::FromString(std::format("{}_{}", stem, id % std::max<size_t>(config.ids, 1))); };
+        if (config.ids && !loc.HasTag(key(0))) throw exc::CoreException(std::format("{} was loaded without its ids", path.string()));
+
+        std::vector<eng::loc::TagKey> hotKeys, coldKeys;
+        uint64_t state = config.seed;
+        for (size_t i = 0; i < HOT_KEYS; ++i) hotKeys.push_back(key(state = util::Mix64(state)));
+        for (size_t i = 0; i < COLD_ROUNDS * COLD_LOOKUPS; ++i) coldKeys.push_back(key(state = util::Mix64(state)));
+
+        std::vector<char> flush(FLUSH_BYTES);
+        size_t checksum = 0;
+        const size_t allocs = allocations.load();
+        auto begin = Clock::now();
+        for (size_t i = 0; i < HOT_LOOKUPS; ++i) checksum += loc.GetStrView(hotKeys[i % HOT_KEYS]).size();
+        const double hot = Seconds(begin, Clock::now());
+
+        double cold = 0;
+        for (size_t round = 0; round < COLD_ROUNDS; ++round)
+        {
+            for (size_t i = 0; i < FLUSH_BYTES; i += 64) flush[i] = static_cast<char>(round + i);
+            begin = Clock::now();
+            for (size_t i = 0; i < COLD_LOOKUPS; ++i) checksum += loc.GetStrView(coldKeys[round * COLD_LOOKUPS + i]).size();
+            cold += Seconds(begin, Clock::now());
+        }
+        const size_t lookupAllocs = allocations.load() - allocs;
+        const size_t peak = PeakResidentBytes();
+
+        const double hotNs = hot * 1e9 / HOT_LOOKUPS;
+        const double coldNs = cold * 1e9 / (COLD_ROUNDS * COLD_LOOKUPS);
+        const double index = std::max(0.0, load - parse);
+
+        lg::Info(std::format("Report: {} ids, {} languages, {:.1f} MB{}", config.ids, config.langs, bytes / 1e6, checksum ? "" : "  EMPTY"));
+        lg::Info(std::format("  parse:  {:8.1f} ms  {:8.1f} MB/s  {} allocations", parse * 1e3, bytes / 1e6 / parse, parseAllocs));
+        lg::Info(std::format("  load:   {:8.1f} ms  (tables: {:.1f} ms)  {} allocations", load * 1e3, index * 1e3, loadAllocs));
+        lg::Info(std::format("  lookup: {:8.1f} ns hot  {:8.1f} ns cold  {} allocations", hotNs, coldNs, lookupAllocs));
+        lg::Info(std::format("  peak resident memory: {:.1f} MB", peak / 1e6));
+
+        if (!json.empty())
+        {
+            std::ofstream out(json, std::ios::binary | std::ios::trunc);
+            if (!out) throw exc::CoreException(std::format("Failed to write {}", json.string()));
+            out << std::format(
+                "{{\n"
+                "  \"corpus\": {{ \"ids\": {}, \"langs\": {}, \"words\": {}, \"variations\": {}, \"inserts\": {}, \"multiline\": {}, "
+                "\"comments\": {}, \"block_comments\": {}, \"seed\": {}, \"bytes\": {} }},\n"
+                "  \"threads\": {},\n"
+                "  \"parse_ms\": {:.3f},\n"
+                "  \"parse_mb_s\": {:.3f},\n"
+                "  \"parse_allocations\": {},\n"
+                "  \"load_ms\": {:.3f},\n"
+                "  \"index_build_ms\": {:.3f},\n"
+                "  \"load_allocations\": {},\n"
+                "  \"lookup_hot_ns\": {:.3f},\n"
+                "  \"lookup_cold_ns\": {:.3f},\n"
+                "  \"lookup_allocations\": {},\n"
+                "  \"peak_rss_bytes\": {}\n"
+                "}}\n",
+                config.ids, config.langs, config.words, config.variations, config.inserts, config.multiline,
+                config.comments, config.blockComments, config.seed, bytes,
+                util::GetThreadCount(), parse * 1e3, bytes / 1e6 / parse, parseAllocs, load * 1e3, index * 1e3, loadAllocs,
+                hotNs, coldNs, lookupAllocs, peak);
+        }
+
+        loc.UnloadFilesAll();
+        std::filesystem::remove(path);
+    }
+
+    // value of a command line option
+    template<typename T>
+    inline T ParseOption(std::string_view option, std::string_view value)
+    {
+        T result{};
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        if (error != std::errc() || end != value.data() + value.size())
+            throw exc::CoreException(std::format("Invalid value \"{}\" of {}", value, option));
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    conf::Init();
+
+    // the report corpus has a bit of everything unless the options say otherwise
+    bench::CorpusConfig config{ .ids = 100'000, .variations = 0.2, .inserts = 0.2, .multiline = 0.1, .comments = 0.3, .blockComments = 0.2, .seed = 1 };
+    std::filesystem::path dir, json;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view option = argv[i];
+            if (!option.starts_with("--"))
+            {
+                dir = option;
+                continue;
+            }
+            if (i + 1 == argc) throw exc::CoreException(std::format("Missing value of {}", option));
+
+            std::string_view value = argv[++i];
+            if (option == "--json")                 json = value;
+            else if (option == "--ids")             config.ids = bench::ParseOption<size_t>(option, value);
+            else if (option == "--langs")           config.langs = bench::ParseOption<size_t>(option, value);
+            else if (option == "--words")           config.words = bench::ParseOption<size_t>(option, value);
+            else if (option == "--seed")            config.seed = bench::ParseOption<uint64_t>(option, value);
+            else if (option == "--variations")      config.variations = bench::ParseOption<double>(option, value);
+            else if (option == "--inserts")         config.inserts = bench::ParseOption<double>(option, value);
+            else if (option == "--multiline")       config.multiline = bench::ParseOption<double>(option, value);
+            else if (option == "--comments")        config.comments = bench::ParseOption<double>(option, value);
+            else if (option == "--block-comments")  config.blockComments = bench::ParseOption<double>(option, value);
+            else throw exc::CoreException(std::format("Unknown option {}", option));
+        }
+
+        if (dir.empty()) dir = std::filesystem::temp_directory_path() / "space_bench_ltf";
+        std::filesystem::create_directories(dir);
+
+        if (json.empty())
+        {
+            bench::LoadScaling(dir);
+            bench::LanguageSwitch(dir);
+            bench::MapLookup();
+            bench::LanguageCodes();
+            bench::IdValidation();
+            bench::StreamingParse(dir);
+            bench::SimdScan(dir);
+            bench::ConcurrentReads(dir);
+            bench::SnapshotRead();
+            bench::CompressedText(dir);
+            bench::BatchLookup(dir);
+        }
+        bench::Report(dir, config, json);
+    }
+    catch (const exc::IException& e)
+    {
+        lg::Error(e.What());
+        return 1;
+    }
+    return 0;
+}
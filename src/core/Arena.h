@@ -0,0 +1,153 @@
+#pragma once
+
+// bump allocator: memory is handed out from large blocks and only released
+// all at once (Clear or destruction). nothing stored in it gets a destructor call,
+// so only trivially destructible data belongs here. not thread safe, use one arena
+// per thread and Splice them together afterwards
+
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+// API ---------------------------------
+
+namespace util
+{
+    class Arena
+    {
+    public:
+        static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+        static constexpr size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+    public:
+        Arena() = default;
+        Arena(Arena&& other) noexcept;
+        Arena& operator=(Arena&& other) noexcept;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* Allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+        template<typename T>
+        T* AllocateArray(size_t count);
+
+        // copies str into the arena
+        std::string_view Store(std::string_view str);
+
+        // takes over all blocks of "other", which is left empty
+        void Splice(Arena& other);
+
+        void Clear();
+
+        size_t GetUsed() const          { return m_used; }          // bytes handed out
+        size_t GetReserved() const      { return m_reserved; }      // bytes in blocks
+        size_t GetBlockCount() const    { return m_blocks.size(); }
+
+    private:
+        void m_AddBlock(size_t minSize);
+
+    private:
+        std::vector<std::unique_ptr<char[]>>    m_blocks;
+        char*                                   m_cur = nullptr;
+        char*                                   m_end = nullptr;
+        size_t                                  m_nextBlockSize = MIN_BLOCK_SIZE;
+        size_t                                  m_used = 0;
+        size_t                                  m_reserved = 0;
+    };
+}
+
+// -------------------------------------
+
+namespace util
+{
+    inline Arena::Arena(Arena&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline Arena& Arena::operator=(Arena&& other) noexcept
+    {
+        if (this == &other) return *this;
+
+        // the source is reset, so it can't hand out memory of blocks it no longer owns
+        m_blocks = std::move(other.m_blocks);
+        m_cur = std::exchange(other.m_cur, nullptr);
+        m_end = std::exchange(other.m_end, nullptr);
+        m_nextBlockSize = std::exchange(other.m_nextBlockSize, MIN_BLOCK_SIZE);
+        m_used = std::exchange(other.m_used, 0);
+        m_reserved = std::exchange(other.m_reserved, 0);
+        other.m_blocks.clear();
+        return *this;
+    }
+
+    inline void* Arena::Allocate(size_t size, size_t align)
+    {
+        uintptr_t cur = reinterpret_cast<uintptr_t>(m_cur);
+        size_t padding = (align - cur % align) % align;
+        if (!m_cur || size + padding > static_cast<size_t>(m_end - m_cur))
+        {
+            m_AddBlock(size + align);
+            cur = reinterpret_cast<uintptr_t>(m_cur);
+            padding = (align - cur % align) % align;
+        }
+
+        char* ptr = m_cur + padding;
+        m_cur = ptr + size;
+        m_used += size;
+        return ptr;
+    }
+
+    template<typename T>
+    inline T* Arena::AllocateArray(size_t count)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destroyed");
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    inline std::string_view Arena::Store(std::string_view str)
+    {
+        if (str.empty()) return {};
+
+        char* ptr = static_cast<char*>(Allocate(str.size(), 1));
+        std::memcpy(ptr, str.data(), str.size());
+        return { ptr, str.size() };
+    }
+
+    inline void Arena::Splice(Arena& other)
+    {
+        // our current block stays last, so allocation continues where it was
+        m_blocks.insert(m_blocks.begin(),
+            std::make_move_iterator(other.m_blocks.begin()), std::make_move_iterator(other.m_blocks.end()));
+        m_used += other.m_used;
+        m_reserved += other.m_reserved;
+        other.m_blocks.clear();
+        other.Clear();
+    }
+
+    inline void Arena::Clear()
+    {
+        m_blocks.clear();
+        m_blocks.shrink_to_fit();
+        m_cur = m_end = nullptr;
+        m_nextBlockSize = MIN_BLOCK_SIZE;
+        m_used = m_reserved = 0;
+    }
+
+    inline void Arena::m_AddBlock(size_t minSize)
+    {
+        // blocks grow with the arena, so small files stay small and big ones use few blocks
+        size_t size = std::max(m_nextBlockSize, minSize);
+        m_nextBlockSize = std::min(m_nextBlockSize * 2, MAX_BLOCK_SIZE);
+
+        m_blocks.push_back(std::make_unique_for_overwrite<char[]>(size));
+        m_cur = m_blocks.back().get();
+        m_end = m_cur + size;
+        m_reserved += size;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+// vectorized search for delimiter characters, used by the ltf parser to skip plain text
+// SSE2 is used as a baseline on x86, AVX2 is picked at runtime if the cpu supports it,
+// on other platforms (or with SetSimdLevel(SimdLevel::SCALAR)) the scalar version is used.
+// all versions return the same result
+
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define SIMD_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define SIMD_TARGET_AVX2
+    #else
+        #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#else
+    #define SIMD_X86 0
+#endif
+
+// API ---------------------------------
+
+namespace util
+{
+    enum class SimdLevel { SCALAR, SSE2, AVX2 };
+
+    inline SimdLevel GetSimdLevel();
+    inline void      SetSimdLevel(SimdLevel level);    // clamped to what the cpu supports, mostly for testing
+
+    // returns a pointer to the first character in [begin, end) equal to one of Cs, or end
+    template<char... Cs> inline const char* FindFirstOf(const char* begin, const char* end);
+}
+
+// -------------------------------------
+
+namespace util
+{
+    namespace itrn
+    {
+        inline SimdLevel DetectSimdLevel()
+        {
+        #if SIMD_X86
+            #if defined(_MSC_VER)
+                int info[4];
+                __cpuidex(info, 0, 0);
+                if (info[0] < 7) return SimdLevel::SSE2;
+
+                __cpuidex(info, 1, 0);
+                bool osxsave = (info[2] & (1 << 27)) != 0;
+                bool avx = (info[2] & (1 << 28)) != 0;
+                if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return SimdLevel::SSE2;
+
+                __cpuidex(info, 7, 0);
+                return (info[1] & (1 << 5)) ? SimdLevel::AVX2 : SimdLevel::SSE2;
+            #else
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+            #endif
+        #else
+            return SimdLevel::SCALAR;
+        #endif
+        }
+
+        inline const SimdLevel supportedSimdLevel = DetectSimdLevel();
+        inline SimdLevel simdLevel = supportedSimdLevel;
+
+        template<char... Cs>
+        inline const char* FindFirstOfScalar(const char* p, const char* end)
+        {
+            for (; p < end; ++p)
+            {
+                if (((*p == Cs) || ...)) return p;
+            }
+            return end;
+        }
+
+    #if SIMD_X86
+        template<char... Cs>
+        inline const char* FindFirstOfSse2(const char* p, const char* end)
+        {
+            while (end - p >= 16)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i hits = _mm_setzero_si128();
+                ((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(Cs)))), ...);
+
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+                if (mask) return p + std::countr_zero(mask);
+                p += 16;
+            }
+            return FindFirstOfScalar<Cs...>(p, end);
+        }
+
+        template<char... Cs>
+        SIMD_TARGET_AVX2 inline const char* FindFirstOfAvx2(const char* p, const char* end)
+        {
+            while (end - p >= 32)
+            {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                __m256i hits = _mm256_setzero_si256();
+                ((hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(Cs)))), ...);
+
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+                if (mask) return p + std::countr_zero(mask);
+                p += 32;
+            }
+            return FindFirstOfSse2<Cs...>(p, end);
+        }
+    #endif
+    }
+
+    inline SimdLevel GetSimdLevel()
+    {
+        return itrn::simdLevel;
+    }
+
+    inline void SetSimdLevel(SimdLevel level)
+    {
+        itrn::simdLevel = level < itrn::supportedSimdLevel ? level : itrn::supportedSimdLevel;
+    }
+
+    template<char... Cs>
+    inline const char* FindFirstOf(const char* begin, const char* end)
+    {
+    #if SIMD_X86
+        switch (itrn::simdLevel)
+        {
+        case SimdLevel::AVX2: return itrn::FindFirstOfAvx2<Cs...>(begin, end);
+        case SimdLevel::SSE2: return itrn::FindFirstOfSse2<Cs...>(begin, end);
+        default: break;
+        }
+    #endif
+        return itrn::FindFirstOfScalar<Cs...>(begin, end);
+    }
+}
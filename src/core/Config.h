@@ -8,6 +8,5 @@ namespace conf
     inline void Init()
     {
         con::Init();
-        lang::LoadLanguageMap(lang::langCodesSL);
     }
 }
\ No newline at end of file
@@ -222,6 +222,17 @@ namespace con
 
 namespace con
 {
+    // internal functions
+    namespace itrn
+    {
+        // for getting underlying value from enum class members
+        template<typename T>
+        constexpr inline auto GetUnderlying(T ecm) -> typename std::underlying_type<T>::type
+        {
+            return static_cast<typename std::underlying_type<T>::type>(ecm);
+        }
+    }
+    // -----------------
     inline void Init() {}
 
     inline void Print(const String& str) { std::cout << str; }
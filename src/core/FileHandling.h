@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
 
 #endif
 
@@ -20,12 +21,22 @@
 
 #include <filesystem>
 #include <sstream>
+#include <string_view>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 // API ---------------------------------
 
 namespace file
 {
     class File; // main class for handling files, prefer this over FileStruct
+    class BlockReader;  // reads a file front to back in blocks, with the next block read ahead
 
     struct FileStruct;    // common struct for both windows and posix files, use with Open, Map, Close, GetContent
     enum class FileMode { READ, WRITE, READ_WRITE };
@@ -35,6 +46,10 @@ namespace file
     inline bool    Map(FileStruct& file);   // file memory mapping
     inline bool    Close(FileStruct& file);
     inline String  GetContent(const FileStruct& file);
+
+    // bytes of a mapping (page aligned, as mmap returns it) that are in memory right now.
+    // 0 on windows, where it can't be asked for cheaply
+    inline size_t  GetResidentBytes(std::string_view mapping);
 }
 
 // -------------------------------------
@@ -44,6 +59,7 @@ namespace file
     // internal functions
     namespace itrn
     {
+    #if WINDOWS_PLATFORM
         inline DWORD GetFileModeWindows(FileMode mode)
         {
             switch (mode)
@@ -76,7 +92,7 @@ namespace file
             default: throw exc::CoreException("Unknown file access mode");
             }
         }
-
+    #else
         inline int GetFileModePosix(FileMode mode)
         {
             switch (mode)
@@ -87,6 +103,12 @@ namespace file
             default: throw exc::CoreException("Unknown file access mode");
             }
         }
+
+        inline String GetLastErrorStr()
+        {
+            return std::strerror(errno);
+        }
+    #endif
     }
 
     struct FileStruct
@@ -99,7 +121,9 @@ namespace file
         PLATFORM_TYPE(HANDLE, int)                  handle;
         PLATFORM_TYPE(LARGE_INTEGER,  struct stat)  stat;
         PLATFORM_TYPE(LPVOID, char*)                map;
+    #if WINDOWS_PLATFORM
         HANDLE                                      mappingWin;      // only used on windows, since there's a 2-step mapping process there
+    #endif
     };
     
     inline bool Open(const std::filesystem::path& path, FileMode mode, FileStruct& file) 
@@ -198,10 +222,10 @@ namespace file
             return false;
         }
 
-        file.map = static_cast<char*>(mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
-        if (file.map = MAP_FAILED)
+        file.map = static_cast<char*>(mmap(NULL, file.stat.st_size, PROT_READ, MAP_PRIVATE, file.handle, 0));
+        if (file.map == MAP_FAILED)
         {
-            throw exc::CoreException("Failed to create file mapping: " + GetLastErrorStr());
+            throw exc::CoreException("Failed to create file mapping: " + itrn::GetLastErrorStr());
             perror("Failed to create file mapping");
             close(file.handle);
             return false;
@@ -232,13 +256,13 @@ namespace file
     // Posix -------------------------
     #else
 
-        if (munmap(file.map, file.stat.st_size) == -1) 
+        if (file.mapped && munmap(file.map, file.stat.st_size) == -1) 
         {
-            throw exc::CoreException("Failed to unmap the file")
+            throw exc::CoreException("Failed to unmap the file");
             perror("Failed to unmap the file");
             return false;
         }
-        close(fd);
+        close(file.handle);
         return true;
 
     #endif
@@ -261,16 +285,41 @@ namespace file
     #if WINDOWS_PLATFORM
 
         //char* content = static_cast<char*>(file.map);
-        return String(static_cast<char*>(file.map));
+        return String(static_cast<char*>(file.map), static_cast<size_t>(file.stat.QuadPart));
 
     // Posix -------------------------
     #else
 
-        return String(file.map);
+        return String(file.map, static_cast<size_t>(file.stat.st_size));
 
     #endif
     }
 
+    inline size_t GetResidentBytes(std::string_view mapping)
+    {
+    #if WINDOWS_PLATFORM
+        (void)mapping;
+        return 0;
+    #else
+        if (mapping.empty()) return 0;
+
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> pages((mapping.size() + page - 1) / page);
+    #if defined(__APPLE__)
+        if (mincore(const_cast<char*>(mapping.data()), mapping.size(), reinterpret_cast<char*>(pages.data())) == -1) return 0;
+    #else
+        if (mincore(const_cast<char*>(mapping.data()), mapping.size(), pages.data()) == -1) return 0;
+    #endif
+
+        size_t resident = 0;
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            if (pages[i] & 1) resident += std::min(page, mapping.size() - i * page);
+        }
+        return resident;
+    #endif
+    }
+
     // main class for handling files, prefer this over FileStruct
     class File
     {
@@ -374,10 +423,10 @@ namespace file
                 return false;
             }
 
-            m_map = static_cast<char*>(mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
-            if (m_map = MAP_FAILED)
+            m_map = static_cast<char*>(mmap(NULL, m_stat.st_size, PROT_READ, MAP_PRIVATE, m_handle, 0));
+            if (m_map == MAP_FAILED)
             {
-                throw exc::CoreException("Failed to create file mapping: " + GetLastErrorStr());
+                throw exc::CoreException("Failed to create file mapping: " + itrn::GetLastErrorStr());
                 perror("Failed to create file mapping");
                 close(m_handle);
                 return false;
@@ -403,6 +452,7 @@ namespace file
                 CloseHandle(m_mappingWin);
             }
             CloseHandle(m_handle);
+            m_open = m_mapped = false;
 
             lg::Debug("Closed the file");
             return true;
@@ -410,13 +460,14 @@ namespace file
         // Posix -------------------------
         #else
 
-            if (munmap(m_map, m_stat.st_size) == -1)
+            if (m_mapped && munmap(m_map, m_stat.st_size) == -1)
             {
-                throw exc::CoreException("Failed to unmap the file")
-                    perror("Failed to unmap the file");
+                throw exc::CoreException("Failed to unmap the file");
+                perror("Failed to unmap the file");
                 return false;
             }
-            close(fd);
+            close(m_handle);
+            m_open = m_mapped = false;
 
             lg::Debug("Closed the file");
             return true;
@@ -441,13 +492,40 @@ namespace file
         // Windows -----------------------
         #if WINDOWS_PLATFORM
 
-            return String(static_cast<char*>(m_map));
+            return String(static_cast<char*>(m_map), GetSize());
 
         // Posix -------------------------
         #else
 
-            return String(m_map);
+            return String(m_map, GetSize());
+
+        #endif
+        }
+
+        // view over the mapped contents, does not copy anything
+        // valid until the file is closed
+        std::string_view GetView() const
+        {
+            if (!m_open || !m_mapped)
+                throw exc::CoreException("Unable to get file view: the file is not open or not mapped");
+
+            return std::string_view(static_cast<const char*>(m_map), GetSize());
+        }
 
+        // of the mapping, see file::GetResidentBytes
+        size_t GetResidentBytes() const
+        {
+            return m_open && m_mapped ? file::GetResidentBytes(GetView()) : 0;
+        }
+
+        size_t GetSize() const
+        {
+            if (!m_open) return 0;
+
+        #if WINDOWS_PLATFORM
+            return static_cast<size_t>(m_stat.QuadPart);
+        #else
+            return static_cast<size_t>(m_stat.st_size);
         #endif
         }
 
@@ -466,6 +544,179 @@ namespace file
         PLATFORM_TYPE(HANDLE, int)                  m_handle;
         PLATFORM_TYPE(LARGE_INTEGER, struct stat)   m_stat;
         PLATFORM_TYPE(LPVOID, char*)                m_map;
+    #if WINDOWS_PLATFORM
         HANDLE                                      m_mappingWin;      // only used on windows, since there's a 2-step mapping process 
+    #endif
+    };
+
+    // reads a file front to back in blocks of a fixed size. the next block is read by a separate
+    // thread while the current one is processed, there are only two buffers, so memory use
+    // doesn't depend on the size of the file
+    class BlockReader
+    {
+    public:
+        BlockReader(const std::filesystem::path& path, size_t blockSize)
+            : m_blockSize(blockSize)
+        {
+        // Windows -----------------------
+        #if WINDOWS_PLATFORM
+
+            m_handle = CreateFile(path.string().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+            if (m_handle == INVALID_HANDLE_VALUE)
+                throw exc::CoreException("Failed to create a file handle with error: " + GetLastErrorStr());
+
+        // Posix -------------------------
+        #else
+
+            m_handle = open(path.string().c_str(), O_RDONLY);
+            if (m_handle == -1)
+                throw exc::CoreException(std::format("Failed to open {}: {}", path.string(), itrn::GetLastErrorStr()));
+            posix_fadvise(m_handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        #endif
+
+            for (auto& buffer : m_buffers) buffer.data = std::make_unique_for_overwrite<char[]>(m_blockSize);
+            m_thread = std::jthread([this](std::stop_token stop) { m_Run(stop); });
+        }
+
+        ~BlockReader()
+        {
+            m_thread.request_stop();
+            if (m_thread.joinable()) m_thread.join();
+
+        #if WINDOWS_PLATFORM
+            CloseHandle(m_handle);
+        #else
+            close(m_handle);
+        #endif
+        }
+
+        BlockReader(const BlockReader&) = delete;
+        BlockReader& operator=(const BlockReader&) = delete;
+
+        // the next block, valid until the next call. empty at the end of the file,
+        // throws exc::CoreException if reading failed
+        std::string_view Next()
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_handedOut)
+            {
+                // the reader thread can fill the block we're done with
+                m_buffers[m_next].full = false;
+                m_next ^= 1;
+                m_handedOut = false;
+                m_cond.notify_all();
+            }
+            if (m_end) return {};
+
+            m_cond.wait(lock, [this]() { return m_buffers[m_next].full; });
+            Buffer& buffer = m_buffers[m_next];
+            if (!buffer.error.empty())
+            {
+                m_end = true;
+                throw exc::CoreException(buffer.error);
+            }
+            if (buffer.size == 0)
+            {
+                m_end = true;
+                return {};
+            }
+
+            m_handedOut = true;
+            return { buffer.data.get(), buffer.size };
+        }
+
+        size_t GetBlockSize() const { return m_blockSize; }
+
+    private:
+        struct Buffer
+        {
+            std::unique_ptr<char[]>     data;
+            size_t                      size = 0;
+            bool                        full = false;   // filled and not yet given back by Next
+            String                      error;
+        };
+
+        void m_Run(std::stop_token stop)
+        {
+            uint64_t offset = 0;
+            for (size_t b = 0;; b ^= 1)
+            {
+                Buffer& buffer = m_buffers[b];
+                {
+                    std::unique_lock lock(m_mutex);
+                    if (!m_cond.wait(lock, stop, [&]() { return !buffer.full; })) return;
+                }
+
+                // filled without the lock, Next doesn't touch a buffer that isn't full
+                size_t size = 0;
+                String error;
+                try
+                {
+                    size = m_ReadAt(buffer.data.get(), offset);
+                }
+                catch (const exc::IException& e)
+                {
+                    error = e.What();
+                }
+                offset += size;
+
+                {
+                    std::scoped_lock lock(m_mutex);
+                    buffer.size = size;
+                    buffer.error = std::move(error);
+                    buffer.full = true;
+                    m_cond.notify_all();
+                    if (size == 0 || !buffer.error.empty()) return;
+                }
+            }
+        }
+
+        // reads up to a block at offset, less only at the end of the file
+        size_t m_ReadAt(char* dst, uint64_t offset)
+        {
+            size_t done = 0;
+            while (done < m_blockSize)
+            {
+            // Windows -----------------------
+            #if WINDOWS_PLATFORM
+
+                OVERLAPPED pos{};
+                pos.Offset = static_cast<DWORD>(offset + done);
+                pos.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+                DWORD read = 0;
+                if (!ReadFile(m_handle, dst + done, static_cast<DWORD>(m_blockSize - done), &read, &pos) && GetLastError() != ERROR_HANDLE_EOF)
+                    throw exc::CoreException("Failed to read a file with error: " + GetLastErrorStr());
+
+            // Posix -------------------------
+            #else
+
+                ssize_t read = pread(m_handle, dst + done, m_blockSize - done, static_cast<off_t>(offset + done));
+                if (read == -1)
+                {
+                    if (errno == EINTR) continue;
+                    throw exc::CoreException("Failed to read a file: " + itrn::GetLastErrorStr());
+                }
+
+            #endif
+
+                if (read == 0) break;
+                done += static_cast<size_t>(read);
+            }
+            return done;
+        }
+
+    private:
+        PLATFORM_TYPE(HANDLE, int)          m_handle;
+        size_t                              m_blockSize;
+        std::array<Buffer, 2>               m_buffers;
+        size_t                              m_next = 0;             // buffer Next hands out
+        bool                                m_handedOut = false;    // m_buffers[m_next] is in use by the caller
+        bool                                m_end = false;
+
+        std::mutex                          m_mutex;
+        std::condition_variable_any         m_cond;
+        std::jthread                        m_thread;               // last, so it stops before the rest is destroyed
     };
 }
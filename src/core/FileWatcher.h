@@ -0,0 +1,266 @@
+#pragma once
+
+// reports changes of files on disk. on linux inotify is used on the parent directories
+// (so editors that save through a temporary file and a rename are caught too),
+// on other platforms modification times are polled.
+// the callback is called on the watcher thread, once per changed file and burst of writes
+
+#include "Defines.h"
+#include "Logging.h"
+
+#if defined(__linux__)
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cstring>
+    #define FILE_WATCHER_INOTIFY 1
+#else
+    #define FILE_WATCHER_INOTIFY 0
+#endif
+
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <system_error>
+#include <format>
+#include <exception>
+
+// API ---------------------------------
+
+namespace file
+{
+    class FileWatcher
+    {
+    public:
+        using Callback = std::function<void(const std::filesystem::path&)>;
+
+        // interval is how often files are polled (without inotify) and how long
+        // a file has to stay unchanged before the callback is called
+        explicit FileWatcher(Callback onChange, std::chrono::milliseconds interval = std::chrono::milliseconds(200));
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        void Watch(const std::filesystem::path& path);
+        void Unwatch(const std::filesystem::path& path);
+
+        // the form paths are reported in
+        static std::filesystem::path Normalize(const std::filesystem::path& path);
+
+    private:
+        struct Watched
+        {
+            std::filesystem::file_time_type         time;
+            uintmax_t                               size = 0;
+            bool                                    pending = false;    // changed, waiting for writes to settle
+            std::chrono::steady_clock::time_point   changed;
+        };
+
+        void m_Run(std::stop_token stop);
+        void m_CheckFiles(std::vector<std::filesystem::path>& changed);
+        static Watched m_Stat(const std::filesystem::path& path);
+
+    #if FILE_WATCHER_INOTIFY
+        void m_ReadEvents();
+    #endif
+
+    private:
+        Callback                                        m_onChange;
+        std::chrono::milliseconds                       m_interval;
+        std::mutex                                      m_mutex;
+        std::unordered_map<std::string, Watched>        m_files;        // by normalized path
+
+    #if FILE_WATCHER_INOTIFY
+        int                                             m_fd = -1;
+        std::unordered_map<std::string, int>            m_dirs;         // watched directory -> watch descriptor
+    #endif
+
+        std::jthread                                    m_thread;       // last, so it stops before the rest is destroyed
+    };
+}
+
+// -------------------------------------
+
+namespace file
+{
+    inline FileWatcher::FileWatcher(Callback onChange, std::chrono::milliseconds interval)
+        : m_onChange(std::move(onChange)), m_interval(interval)
+    {
+    #if FILE_WATCHER_INOTIFY
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0) lg::Warning(std::format("inotify is not available ({}), polling files instead", std::strerror(errno)));
+    #endif
+        m_thread = std::jthread([this](std::stop_token stop) { m_Run(stop); });
+    }
+
+    inline FileWatcher::~FileWatcher()
+    {
+        m_thread.request_stop();
+        if (m_thread.joinable()) m_thread.join();
+    #if FILE_WATCHER_INOTIFY
+        if (m_fd >= 0) close(m_fd);
+    #endif
+    }
+
+    inline void FileWatcher::Watch(const std::filesystem::path& path)
+    {
+        const std::filesystem::path norm = Normalize(path);
+        std::scoped_lock lock(m_mutex);
+        m_files[norm.string()] = m_Stat(norm);
+
+    #if FILE_WATCHER_INOTIFY
+        const std::string dir = norm.parent_path().string();
+        if (m_fd >= 0 && !m_dirs.contains(dir))
+        {
+            int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0) m_dirs[dir] = wd;
+            else lg::Warning(std::format("Failed to watch {} ({}), it will be polled", dir, std::strerror(errno)));
+        }
+    #endif
+    }
+
+    inline void FileWatcher::Unwatch(const std::filesystem::path& path)
+    {
+        const std::filesystem::path norm = Normalize(path);
+        std::scoped_lock lock(m_mutex);
+        m_files.erase(norm.string());
+
+    #if FILE_WATCHER_INOTIFY
+        // the directory stays watched while other files in it are
+        const std::string dir = norm.parent_path().string();
+        for (const auto& [file, watched] : m_files)
+        {
+            if (std::filesystem::path(file).parent_path() == dir) return;
+        }
+        if (auto it = m_dirs.find(dir); it != m_dirs.end())
+        {
+            inotify_rm_watch(m_fd, it->second);
+            m_dirs.erase(it);
+        }
+    #endif
+    }
+
+    inline std::filesystem::path FileWatcher::Normalize(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        std::filesystem::path abs = std::filesystem::absolute(path, ec);
+        return (ec ? path : abs).lexically_normal();
+    }
+
+    inline void FileWatcher::m_Run(std::stop_token stop)
+    {
+        std::vector<std::filesystem::path> changed;
+        while (!stop.stop_requested())
+        {
+        #if FILE_WATCHER_INOTIFY
+            if (m_fd >= 0)
+            {
+                pollfd pfd{ m_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, static_cast<int>(m_interval.count())) > 0) m_ReadEvents();
+            }
+            else std::this_thread::sleep_for(m_interval);
+        #else
+            std::this_thread::sleep_for(m_interval);
+        #endif
+
+            changed.clear();
+            m_CheckFiles(changed);
+            for (const auto& path : changed)
+            {
+                if (stop.stop_requested()) return;
+
+                // an exception leaving this thread would terminate the process
+                try
+                {
+                    m_onChange(path);
+                }
+                catch (const std::exception& e)
+                {
+                    lg::Error(std::format("Handling the change of {} failed: {}", path.string(), e.what()));
+                }
+                catch (...)
+                {
+                    lg::Error(std::format("Handling the change of {} failed", path.string()));
+                }
+            }
+        }
+    }
+
+    // a file is reported once it stopped changing for one interval, so
+    // a save that takes several writes (or a rename) is reported once
+    inline void FileWatcher::m_CheckFiles(std::vector<std::filesystem::path>& changed)
+    {
+        const auto time = std::chrono::steady_clock::now();
+        std::scoped_lock lock(m_mutex);
+        for (auto& [file, watched] : m_files)
+        {
+            Watched now = m_Stat(file);
+            if (now.time != watched.time || now.size != watched.size)
+            {
+                watched = now;
+                watched.pending = true;
+                watched.changed = time;
+            }
+            else if (watched.pending && time - watched.changed >= m_interval)
+            {
+                watched.pending = false;
+                if (now.time != std::filesystem::file_time_type::min()) changed.emplace_back(file);     // not while it's missing
+            }
+        }
+    }
+
+    inline FileWatcher::Watched FileWatcher::m_Stat(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        Watched watched;
+        watched.time = std::filesystem::last_write_time(path, ec);
+        if (ec) return { std::filesystem::file_time_type::min(), 0, false, {} };
+        watched.size = std::filesystem::file_size(path, ec);
+        return watched;
+    }
+
+#if FILE_WATCHER_INOTIFY
+    // events only wake the thread up early, what changed is decided by m_CheckFiles.
+    // (a write can keep the modification time within the clock's resolution, so files
+    // named by an event are always marked as pending)
+    inline void FileWatcher::m_ReadEvents()
+    {
+        alignas(inotify_event) char buffer[4096];
+        std::vector<std::pair<int, std::string>> events;
+        for (ssize_t len; (len = read(m_fd, buffer, sizeof(buffer))) > 0;)
+        {
+            for (ssize_t i = 0; i < len;)
+            {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + i);
+                if (event->len > 0) events.emplace_back(event->wd, event->name);
+                i += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        const auto time = std::chrono::steady_clock::now();
+        std::scoped_lock lock(m_mutex);
+        for (const auto& [eventWd, name] : events)
+        {
+            for (const auto& [dir, wd] : m_dirs)
+            {
+                if (wd != eventWd) continue;
+
+                const std::string file = (std::filesystem::path(dir) / name).string();
+                if (auto it = m_files.find(file); it != m_files.end())
+                {
+                    it->second = m_Stat(file);
+                    it->second.pending = true;
+                    it->second.changed = time;
+                }
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+// open addressing hash map: elements are stored back to back in a vector,
+// a separate power of two table of (hash, index) pairs is probed linearly.
+// lookups touch one small bucket and one element, iteration is a plain vector walk.
+// with a transparent hash (like the one for std::string) keys can be looked up
+// by std::string_view without building a temporary string.
+// insertion and erasing move elements, so pointers and iterators to them are invalidated.
+// many keys can be looked up together with hash_of / prefetch / prefetch_value / find(key, hash),
+// so the cache misses of all of them overlap instead of following each other
+
+#include "StringUtil.h"
+#include "Exception.h"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <tuple>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <xmmintrin.h>
+#endif
+
+// API ---------------------------------
+
+namespace util
+{
+    // hint that *ptr will be read soon, does nothing where there's no such instruction
+    inline void Prefetch(const void* ptr)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(ptr);
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+    #else
+        (void)ptr;
+    #endif
+    }
+
+    template<typename Key>
+    struct FlatHash
+    {
+        uint64_t operator()(const Key& key) const { return Mix64(static_cast<uint64_t>(std::hash<Key>{}(key))); }
+    };
+
+    template<>
+    struct FlatHash<std::string>
+    {
+        using is_transparent = void;
+        uint64_t operator()(std::string_view key) const { return static_cast<uint64_t>(std::hash<std::string_view>{}(key)); }
+    };
+
+    template<typename Key, typename Value, typename Hash = FlatHash<Key>, typename Equal = std::equal_to<>>
+    class FlatMap
+    {
+    public:
+        using key_type          = Key;
+        using mapped_type       = Value;
+        using value_type        = std::pair<Key, Value>;
+        using iterator          = typename std::vector<value_type>::iterator;
+        using const_iterator    = typename std::vector<value_type>::const_iterator;
+
+    public:
+        FlatMap() = default;
+
+        iterator        begin()         { return m_values.begin(); }
+        iterator        end()           { return m_values.end(); }
+        const_iterator  begin() const   { return m_values.begin(); }
+        const_iterator  end() const     { return m_values.end(); }
+
+        size_t  size() const    { return m_values.size(); }
+        bool    empty() const   { return m_values.empty(); }
+        size_t  allocated_bytes() const;    // by the map itself, not by what keys and values own
+        void    clear();
+        void    reserve(size_t count);
+
+        iterator        find(const Key& key)                { return m_Find(key); }
+        const_iterator  find(const Key& key) const          { return const_cast<FlatMap*>(this)->m_Find(key); }
+        bool            contains(const Key& key) const      { return find(key) != end(); }
+        Value&          at(const Key& key)                  { return m_At(key); }
+        const Value&    at(const Key& key) const            { return const_cast<FlatMap*>(this)->m_At(key); }
+
+        // heterogeneous versions, only with a transparent hash
+        template<typename K, typename H = Hash, typename = typename H::is_transparent>
+        iterator        find(const K& key)                  { return m_Find(key); }
+        template<typename K, typename H = Hash, typename = typename H::is_transparent>
+        const_iterator  find(const K& key) const            { return const_cast<FlatMap*>(this)->m_Find(key); }
+        template<typename K, typename H = Hash, typename = typename H::is_transparent>
+        bool            contains(const K& key) const        { return find(key) != end(); }
+        template<typename K, typename H = Hash, typename = typename H::is_transparent>
+        Value&          at(const K& key)                    { return m_At(key); }
+        template<typename K, typename H = Hash, typename = typename H::is_transparent>
+        const Value&    at(const K& key) const              { return const_cast<FlatMap*>(this)->m_At(key); }
+
+        // the key is only converted to Key if it gets inserted
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> try_emplace(K&& key, Args&&... args);
+
+        template<typename K>
+        Value& operator[](K&& key) { return try_emplace(std::forward<K>(key)).first->second; }
+
+        template<typename K>
+        size_t erase(const K& key);
+
+        // batched lookups: hash every key, prefetch every bucket, then every element, then find
+        template<typename K>
+        uint64_t        hash_of(const K& key) const { return m_Hash(key); }
+        void            prefetch(uint64_t hash) const;          // the bucket the probe for hash starts at
+        void            prefetch_value(uint64_t hash) const;    // the element of the first bucket that may match, reads the bucket
+        template<typename K>
+        const_iterator  find(const K& key, uint64_t hash) const;
+
+    private:
+        struct Bucket
+        {
+            uint32_t    hash = 0;           // upper half of the hash, to skip most key comparisons
+            uint32_t    index = EMPTY;      // into m_values
+        };
+
+        static constexpr uint32_t   EMPTY = UINT32_MAX;
+        static constexpr size_t     MIN_BUCKETS = 16;
+
+        template<typename K> uint64_t m_Hash(const K& key) const { return static_cast<uint64_t>(Hash{}(key)); }
+        static uint32_t m_Tag(uint64_t hash) { return static_cast<uint32_t>(hash >> 32); }
+        size_t m_Mask() const { return m_buckets.size() - 1; }
+
+        template<typename K> size_t m_FindBucket(const K& key, uint64_t hash) const;
+        template<typename K> iterator m_Find(const K& key);
+        template<typename K> Value& m_At(const K& key);
+        void m_Rehash(size_t bucketCount);
+        void m_Place(uint32_t tag, size_t pos, uint32_t index);
+
+    private:
+        std::vector<value_type>     m_values;
+        std::vector<Bucket>         m_buckets;
+    };
+}
+
+// -------------------------------------
+
+namespace util
+{
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline size_t FlatMap<Key, Value, Hash, Equal>::allocated_bytes() const
+    {
+        return m_values.capacity() * sizeof(value_type) + m_buckets.capacity() * sizeof(Bucket);
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::clear()
+    {
+        m_values.clear();
+        m_buckets.clear();
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::reserve(size_t count)
+    {
+        m_values.reserve(count);
+
+        // kept at most 7/8 full
+        size_t buckets = MIN_BUCKETS;
+        while (buckets - buckets / 8 < count) buckets *= 2;
+        if (buckets > m_buckets.size()) m_Rehash(buckets);
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K, typename... Args>
+    inline auto FlatMap<Key, Value, Hash, Equal>::try_emplace(K&& key, Args&&... args) -> std::pair<iterator, bool>
+    {
+        if (m_values.size() + 1 > m_buckets.size() - m_buckets.size() / 8)
+            m_Rehash(m_buckets.empty() ? MIN_BUCKETS : m_buckets.size() * 2);
+
+        const uint64_t hash = m_Hash(key);
+        const uint32_t tag = m_Tag(hash);
+        size_t pos = hash & m_Mask();
+        for (; m_buckets[pos].index != EMPTY; pos = (pos + 1) & m_Mask())
+        {
+            const Bucket& bucket = m_buckets[pos];
+            if (bucket.hash == tag && Equal{}(m_values[bucket.index].first, key))
+                return { m_values.begin() + bucket.index, false };
+        }
+
+        if (m_values.size() >= EMPTY) throw exc::CoreException("FlatMap is full");
+
+        m_values.emplace_back(std::piecewise_construct,
+            std::forward_as_tuple(Key(std::forward<K>(key))),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        m_buckets[pos] = { tag, static_cast<uint32_t>(m_values.size() - 1) };
+        return { m_values.end() - 1, true };
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K>
+    inline size_t FlatMap<Key, Value, Hash, Equal>::erase(const K& key)
+    {
+        if (m_buckets.empty()) return 0;
+
+        size_t pos = m_FindBucket(key, m_Hash(key));
+        if (pos == SIZE_MAX) return 0;
+
+        const uint32_t index = m_buckets[pos].index;
+
+        // backward shift: pull later buckets of the probe sequence into the hole
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & m_Mask(); m_buckets[next].index != EMPTY; next = (next + 1) & m_Mask())
+        {
+            size_t home = m_Hash(m_values[m_buckets[next].index].first) & m_Mask();
+            if (((next - home) & m_Mask()) >= ((next - hole) & m_Mask()))
+            {
+                m_buckets[hole] = m_buckets[next];
+                hole = next;
+            }
+        }
+        m_buckets[hole] = {};
+
+        // the last element takes the place of the erased one
+        const uint32_t last = static_cast<uint32_t>(m_values.size() - 1);
+        if (index != last)
+        {
+            m_buckets[m_FindBucket(m_values[last].first, m_Hash(m_values[last].first))].index = index;
+            m_values[index] = std::move(m_values[last]);
+        }
+        m_values.pop_back();
+        return 1;
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::prefetch(uint64_t hash) const
+    {
+        if (!m_buckets.empty()) Prefetch(&m_buckets[hash & m_Mask()]);
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::prefetch_value(uint64_t hash) const
+    {
+        if (m_buckets.empty()) return;
+
+        const uint32_t tag = m_Tag(hash);
+        for (size_t pos = hash & m_Mask(); m_buckets[pos].index != EMPTY; pos = (pos + 1) & m_Mask())
+        {
+            if (m_buckets[pos].hash != tag) continue;
+            Prefetch(&m_values[m_buckets[pos].index]);
+            return;
+        }
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K>
+    inline auto FlatMap<Key, Value, Hash, Equal>::find(const K& key, uint64_t hash) const -> const_iterator
+    {
+        if (m_buckets.empty()) return end();
+
+        size_t pos = m_FindBucket(key, hash);
+        return pos == SIZE_MAX ? end() : m_values.begin() + m_buckets[pos].index;
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K>
+    inline size_t FlatMap<Key, Value, Hash, Equal>::m_FindBucket(const K& key, uint64_t hash) const
+    {
+        const uint32_t tag = m_Tag(hash);
+        for (size_t pos = hash & m_Mask(); m_buckets[pos].index != EMPTY; pos = (pos + 1) & m_Mask())
+        {
+            const Bucket& bucket = m_buckets[pos];
+            if (bucket.hash == tag && Equal{}(m_values[bucket.index].first, key)) return pos;
+        }
+        return SIZE_MAX;
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K>
+    inline auto FlatMap<Key, Value, Hash, Equal>::m_Find(const K& key) -> iterator
+    {
+        if (m_buckets.empty()) return end();
+
+        size_t pos = m_FindBucket(key, m_Hash(key));
+        return pos == SIZE_MAX ? end() : m_values.begin() + m_buckets[pos].index;
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    template<typename K>
+    inline Value& FlatMap<Key, Value, Hash, Equal>::m_At(const K& key)
+    {
+        auto it = m_Find(key);
+        if (it == end()) throw exc::CoreException("FlatMap key not found");
+        return it->second;
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::m_Rehash(size_t bucketCount)
+    {
+        m_buckets.assign(bucketCount, {});
+        for (uint32_t i = 0; i < m_values.size(); ++i)
+        {
+            uint64_t hash = m_Hash(m_values[i].first);
+            m_Place(m_Tag(hash), hash & m_Mask(), i);
+        }
+    }
+
+    template<typename Key, typename Value, typename Hash, typename Equal>
+    inline void FlatMap<Key, Value, Hash, Equal>::m_Place(uint32_t tag, size_t pos, uint32_t index)
+    {
+        while (m_buckets[pos].index != EMPTY) pos = (pos + 1) & m_Mask();
+        m_buckets[pos] = { tag, index };
+    }
+}
@@ -1,9 +1,18 @@
 #pragma once
 
-#include <unordered_map>
-#include <string>
-#include <optional>
+// languages and their codes: every ISO 639-1 code and common BCP 47 tags with a region or script
+// subtag (pt-BR, zh-Hant). codes are looked up through a perfect hash built at compile time,
+// so the .ltf parser pays a multiply and one compare per language header.
+// only the header languages (see SetHeaderLanguages) are read as headers in .ltf files
+
+#include "Types.h"
+
+#include <array>
+#include <string_view>
 #include <cstdint>
+#include <cstddef>
+#include <bitset>
+#include <atomic>
 #include <utility>
 
 namespace lang
@@ -11,6 +20,8 @@ namespace lang
     enum class Language
     {
         NONE,
+
+        // the first ones keep their values, .ltfb files store them
         ENGLISH,
         RUSSIAN,
         JAPANESE,
@@ -20,69 +31,273 @@ namespace lang
         GERMAN,
         PORTUGESE,
         FRENCH,
-        HINDI
+        HINDI,
+
+        // the rest of ISO 639-1
+        AFAR, ABKHAZIAN, AVESTAN, AFRIKAANS, AKAN, AMHARIC, ARAGONESE, ASSAMESE, AVARIC, AYMARA, AZERBAIJANI, BASHKIR,
+        BELARUSIAN, BULGARIAN, BISLAMA, BAMBARA, BENGALI, TIBETAN, BRETON, BOSNIAN, CATALAN, CHECHEN, CHAMORRO,
+        CORSICAN, CREE, CZECH, CHURCH_SLAVIC, CHUVASH, WELSH, DANISH, DIVEHI, DZONGKHA, EWE, GREEK, ESPERANTO, ESTONIAN,
+        BASQUE, PERSIAN, FULAH, FINNISH, FIJIAN, FAROESE, WESTERN_FRISIAN, IRISH, SCOTTISH_GAELIC, GALICIAN, GUARANI,
+        GUJARATI, MANX, HAUSA, HEBREW, HIRI_MOTU, CROATIAN, HAITIAN, HUNGARIAN, ARMENIAN, HERERO, INTERLINGUA,
+        INDONESIAN, INTERLINGUE, IGBO, SICHUAN_YI, INUPIAQ, IDO, ICELANDIC, ITALIAN, INUKTITUT, JAVANESE, GEORGIAN,
+        KONGO, KIKUYU, KUANYAMA, KAZAKH, KALAALLISUT, KHMER, KANNADA, KOREAN, KANURI, KASHMIRI, KURDISH, KOMI, CORNISH,
+        KYRGYZ, LATIN, LUXEMBOURGISH, GANDA, LIMBURGISH, LINGALA, LAO, LITHUANIAN, LUBA_KATANGA, LATVIAN, MALAGASY,
+        MARSHALLESE, MAORI, MACEDONIAN, MALAYALAM, MONGOLIAN, MARATHI, MALAY, MALTESE, BURMESE, NAURU, NORWEGIAN_BOKMAL,
+        NORTH_NDEBELE, NEPALI, NDONGA, DUTCH, NORWEGIAN_NYNORSK, NORWEGIAN, SOUTH_NDEBELE, NAVAJO, CHICHEWA, OCCITAN,
+        OJIBWA, OROMO, ORIYA, OSSETIAN, PUNJABI, PALI, POLISH, PASHTO, QUECHUA, ROMANSH, RUNDI, ROMANIAN, KINYARWANDA,
+        SANSKRIT, SARDINIAN, SINDHI, NORTHERN_SAMI, SANGO, SERBO_CROATIAN, SINHALA, SLOVAK, SLOVENIAN, SAMOAN, SHONA,
+        SOMALI, ALBANIAN, SERBIAN, SWATI, SOUTHERN_SOTHO, SUNDANESE, SWEDISH, SWAHILI, TAMIL, TELUGU, TAJIK, THAI,
+        TIGRINYA, TURKMEN, TAGALOG, TSWANA, TONGA, TURKISH, TSONGA, TATAR, TWI, TAHITIAN, UYGHUR, UKRAINIAN, URDU,
+        UZBEK, VENDA, VIETNAMESE, VOLAPUK, WALLOON, WOLOF, XHOSA, YIDDISH, YORUBA, ZHUANG, ZULU,
+
+        // BCP 47 tags with a region or script subtag
+        ENGLISH_UK,
+        ENGLISH_US,
+        SPANISH_SPAIN,
+        SPANISH_MEXICO,
+        SPANISH_LATIN_AMERICA,
+        FRENCH_FRANCE,
+        FRENCH_CANADA,
+        GERMAN_GERMANY,
+        GERMAN_AUSTRIA,
+        GERMAN_SWITZERLAND,
+        PORTUGESE_BRAZIL,
+        PORTUGESE_PORTUGAL,
+        CHINESE_SIMPLIFIED,
+        CHINESE_TRADITIONAL,
+        CHINESE_CHINA,
+        CHINESE_TAIWAN,
+        CHINESE_HONG_KONG,
+        SERBIAN_CYRILLIC,
+        SERBIAN_LATIN
     };
 
-    inline std::unordered_map<std::string, Language> langCodesSL;  // initialize on Localization init
+    inline constexpr size_t LANGUAGE_COUNT = static_cast<size_t>(Language::SERBIAN_LATIN) + 1;
+    using LanguageSet = std::bitset<LANGUAGE_COUNT>;    // indexed by Language values
+
+    // "none" for Language::NONE
+    constexpr std::string_view GetLanguageCode(Language lang) noexcept;
+    inline String GetLanguageCodeStr(Language lang) noexcept { return String(GetLanguageCode(lang)); }
+
+    // Language::NONE if the code isn't known. codes are matched as written in the tables above
+    // (lowercase language, uppercase region, titlecase script)
+    constexpr Language GetLanguageCodeEnum(std::string_view code) noexcept;
 
-    inline String GetLanguageCodeStr(Language lang) noexcept
+    // languages .ltf files can have headers for. every code converts with GetLanguageCodeEnum, but a bracket
+    // holding just a code ([no], [it]) is an id unless its language is enabled here, so files written when only
+    // ten languages were known parse the same. by default those ten and every tag with a subtag are enabled.
+    // meant to be set before files are loaded, a parse that runs at the same time may see either set
+    inline LanguageSet  GetHeaderLanguages() noexcept;
+    inline void         SetHeaderLanguages(const LanguageSet& languages) noexcept;
+    inline bool         IsHeaderLanguage(Language lang) noexcept;
+}
+
+// -------------------------------------
+
+namespace lang
+{
+    namespace itrn
     {
-        switch (lang)
+        struct LanguageCode
+        {
+            Language            lan;
+            std::string_view    code;
+        };
+
+        consteval std::array<LanguageCode, LANGUAGE_COUNT - 1> MakeLanguageCodes()
         {
-        case Language::ENGLISH:     return "en";
-        case Language::RUSSIAN:     return "ru";
-        case Language::JAPANESE:    return "ja";
-        case Language::CHINESE:     return "zh";
-        case Language::SPANISH:     return "es";
-        case Language::ARABIC:      return "ar";
-        case Language::GERMAN:      return "de";
-        case Language::PORTUGESE:   return "pt";
-        case Language::FRENCH:      return "fr";
-        case Language::HINDI:       return "hi";
-        default:                    return "none";
+            using enum Language;
+            return { {
+            { ENGLISH, "en" }, { RUSSIAN, "ru" }, { JAPANESE, "ja" }, { CHINESE, "zh" }, { SPANISH, "es" },
+            { ARABIC, "ar" }, { GERMAN, "de" }, { PORTUGESE, "pt" }, { FRENCH, "fr" }, { HINDI, "hi" },
+
+            { AFAR, "aa" }, { ABKHAZIAN, "ab" }, { AVESTAN, "ae" }, { AFRIKAANS, "af" }, { AKAN, "ak" },
+            { AMHARIC, "am" }, { ARAGONESE, "an" }, { ASSAMESE, "as" }, { AVARIC, "av" }, { AYMARA, "ay" },
+            { AZERBAIJANI, "az" }, { BASHKIR, "ba" }, { BELARUSIAN, "be" }, { BULGARIAN, "bg" }, { BISLAMA, "bi" },
+            { BAMBARA, "bm" }, { BENGALI, "bn" }, { TIBETAN, "bo" }, { BRETON, "br" }, { BOSNIAN, "bs" },
+            { CATALAN, "ca" }, { CHECHEN, "ce" }, { CHAMORRO, "ch" }, { CORSICAN, "co" }, { CREE, "cr" },
+            { CZECH, "cs" }, { CHURCH_SLAVIC, "cu" }, { CHUVASH, "cv" }, { WELSH, "cy" }, { DANISH, "da" },
+            { DIVEHI, "dv" }, { DZONGKHA, "dz" }, { EWE, "ee" }, { GREEK, "el" }, { ESPERANTO, "eo" },
+            { ESTONIAN, "et" }, { BASQUE, "eu" }, { PERSIAN, "fa" }, { FULAH, "ff" }, { FINNISH, "fi" },
+            { FIJIAN, "fj" }, { FAROESE, "fo" }, { WESTERN_FRISIAN, "fy" }, { IRISH, "ga" },
+            { SCOTTISH_GAELIC, "gd" }, { GALICIAN, "gl" }, { GUARANI, "gn" }, { GUJARATI, "gu" }, { MANX, "gv" },
+            { HAUSA, "ha" }, { HEBREW, "he" }, { HIRI_MOTU, "ho" }, { CROATIAN, "hr" }, { HAITIAN, "ht" },
+            { HUNGARIAN, "hu" }, { ARMENIAN, "hy" }, { HERERO, "hz" }, { INTERLINGUA, "ia" }, { INDONESIAN, "id" },
+            { INTERLINGUE, "ie" }, { IGBO, "ig" }, { SICHUAN_YI, "ii" }, { INUPIAQ, "ik" }, { IDO, "io" },
+            { ICELANDIC, "is" }, { ITALIAN, "it" }, { INUKTITUT, "iu" }, { JAVANESE, "jv" }, { GEORGIAN, "ka" },
+            { KONGO, "kg" }, { KIKUYU, "ki" }, { KUANYAMA, "kj" }, { KAZAKH, "kk" }, { KALAALLISUT, "kl" },
+            { KHMER, "km" }, { KANNADA, "kn" }, { KOREAN, "ko" }, { KANURI, "kr" }, { KASHMIRI, "ks" },
+            { KURDISH, "ku" }, { KOMI, "kv" }, { CORNISH, "kw" }, { KYRGYZ, "ky" }, { LATIN, "la" },
+            { LUXEMBOURGISH, "lb" }, { GANDA, "lg" }, { LIMBURGISH, "li" }, { LINGALA, "ln" }, { LAO, "lo" },
+            { LITHUANIAN, "lt" }, { LUBA_KATANGA, "lu" }, { LATVIAN, "lv" }, { MALAGASY, "mg" },
+            { MARSHALLESE, "mh" }, { MAORI, "mi" }, { MACEDONIAN, "mk" }, { MALAYALAM, "ml" }, { MONGOLIAN, "mn" },
+            { MARATHI, "mr" }, { MALAY, "ms" }, { MALTESE, "mt" }, { BURMESE, "my" }, { NAURU, "na" },
+            { NORWEGIAN_BOKMAL, "nb" }, { NORTH_NDEBELE, "nd" }, { NEPALI, "ne" }, { NDONGA, "ng" },
+            { DUTCH, "nl" }, { NORWEGIAN_NYNORSK, "nn" }, { NORWEGIAN, "no" }, { SOUTH_NDEBELE, "nr" },
+            { NAVAJO, "nv" }, { CHICHEWA, "ny" }, { OCCITAN, "oc" }, { OJIBWA, "oj" }, { OROMO, "om" },
+            { ORIYA, "or" }, { OSSETIAN, "os" }, { PUNJABI, "pa" }, { PALI, "pi" }, { POLISH, "pl" },
+            { PASHTO, "ps" }, { QUECHUA, "qu" }, { ROMANSH, "rm" }, { RUNDI, "rn" }, { ROMANIAN, "ro" },
+            { KINYARWANDA, "rw" }, { SANSKRIT, "sa" }, { SARDINIAN, "sc" }, { SINDHI, "sd" },
+            { NORTHERN_SAMI, "se" }, { SANGO, "sg" }, { SERBO_CROATIAN, "sh" }, { SINHALA, "si" }, { SLOVAK, "sk" },
+            { SLOVENIAN, "sl" }, { SAMOAN, "sm" }, { SHONA, "sn" }, { SOMALI, "so" }, { ALBANIAN, "sq" },
+            { SERBIAN, "sr" }, { SWATI, "ss" }, { SOUTHERN_SOTHO, "st" }, { SUNDANESE, "su" }, { SWEDISH, "sv" },
+            { SWAHILI, "sw" }, { TAMIL, "ta" }, { TELUGU, "te" }, { TAJIK, "tg" }, { THAI, "th" },
+            { TIGRINYA, "ti" }, { TURKMEN, "tk" }, { TAGALOG, "tl" }, { TSWANA, "tn" }, { TONGA, "to" },
+            { TURKISH, "tr" }, { TSONGA, "ts" }, { TATAR, "tt" }, { TWI, "tw" }, { TAHITIAN, "ty" },
+            { UYGHUR, "ug" }, { UKRAINIAN, "uk" }, { URDU, "ur" }, { UZBEK, "uz" }, { VENDA, "ve" },
+            { VIETNAMESE, "vi" }, { VOLAPUK, "vo" }, { WALLOON, "wa" }, { WOLOF, "wo" }, { XHOSA, "xh" },
+            { YIDDISH, "yi" }, { YORUBA, "yo" }, { ZHUANG, "za" }, { ZULU, "zu" },
+
+            { ENGLISH_UK, "en-GB" }, { ENGLISH_US, "en-US" }, { SPANISH_SPAIN, "es-ES" },
+            { SPANISH_MEXICO, "es-MX" }, { SPANISH_LATIN_AMERICA, "es-419" }, { FRENCH_FRANCE, "fr-FR" },
+            { FRENCH_CANADA, "fr-CA" }, { GERMAN_GERMANY, "de-DE" }, { GERMAN_AUSTRIA, "de-AT" },
+            { GERMAN_SWITZERLAND, "de-CH" }, { PORTUGESE_BRAZIL, "pt-BR" }, { PORTUGESE_PORTUGAL, "pt-PT" },
+            { CHINESE_SIMPLIFIED, "zh-Hans" }, { CHINESE_TRADITIONAL, "zh-Hant" }, { CHINESE_CHINA, "zh-CN" },
+            { CHINESE_TAIWAN, "zh-TW" }, { CHINESE_HONG_KONG, "zh-HK" }, { SERBIAN_CYRILLIC, "sr-Cyrl" },
+            { SERBIAN_LATIN, "sr-Latn" }
+            } };
         }
+
+        inline constexpr size_t LANGUAGE_CODE_MAX = 7;          // "zh-Hant"
+        inline constexpr size_t LANGUAGE_HASH_BITS = 12;
+
+        // the code in the low bytes and its size in the top one, so a code is one compare. longer
+        // strings give 0, which no code packs to
+        constexpr uint64_t PackLanguageCode(std::string_view code) noexcept
+        {
+            const size_t size = code.size() <= LANGUAGE_CODE_MAX ? code.size() : 0;
+            uint64_t key = static_cast<uint64_t>(size) << 56;
+            for (size_t i = 0; i < size; ++i) key |= static_cast<uint64_t>(static_cast<unsigned char>(code[i])) << (8 * i);
+            return key;
+        }
+
+        constexpr size_t HashLanguageCode(uint64_t key, uint64_t multiplier) noexcept
+        {
+            return static_cast<size_t>((key * multiplier) >> (64 - LANGUAGE_HASH_BITS));
+        }
+
+        struct LanguageHash
+        {
+            uint64_t                                            multiplier = 0;
+            std::array<uint8_t, size_t(1) << LANGUAGE_HASH_BITS> slots{};       // Language values, 0 (NONE) if empty
+            std::array<uint64_t, LANGUAGE_COUNT>                keys{};         // packed codes by Language value
+            std::array<std::string_view, LANGUAGE_COUNT>        codes{};
+        };
+
+        // tries multipliers until one puts every code in a slot of its own
+        consteval LanguageHash MakeLanguageHash()
+        {
+            static_assert(LANGUAGE_COUNT <= 256, "slots hold Language values in a byte");
+
+            LanguageHash hash;
+            hash.codes[0] = "none";
+            for (const LanguageCode& lc : MakeLanguageCodes())
+            {
+                const size_t lan = static_cast<size_t>(lc.lan);
+                if (lan == 0 || !hash.codes[lan].empty() || lc.code.size() > LANGUAGE_CODE_MAX)
+                    throw "a language is listed twice or its code is too long";
+                hash.codes[lan] = lc.code;
+                hash.keys[lan] = PackLanguageCode(lc.code);
+            }
+
+            std::array<uint16_t, size_t(1) << LANGUAGE_HASH_BITS> used{};     // the try that last took a slot
+            uint64_t state = 0x9E3779B97F4A7C15ull;
+            for (uint16_t attempt = 1; attempt != 0; ++attempt)
+            {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                const uint64_t multiplier = state | 1;
+
+                bool perfect = true;
+                for (size_t lan = 1; lan < LANGUAGE_COUNT && perfect; ++lan)
+                {
+                    const size_t slot = HashLanguageCode(hash.keys[lan], multiplier);
+                    perfect = used[slot] != attempt;
+                    used[slot] = attempt;
+                }
+                if (!perfect) continue;
+
+                hash.multiplier = multiplier;
+                for (size_t lan = 1; lan < LANGUAGE_COUNT; ++lan)
+                    hash.slots[HashLanguageCode(hash.keys[lan], multiplier)] = static_cast<uint8_t>(lan);
+                return hash;
+            }
+            throw "no perfect hash for the language codes";
+        }
+
+        inline constexpr LanguageHash languageHash = MakeLanguageHash();
     }
 
-    inline Language GetLanguageCodeEnum(const std::string& code) noexcept
+    constexpr std::string_view GetLanguageCode(Language lang) noexcept
     {
-        if (code == "en") return Language::ENGLISH;
-        else if (code == "ru") return Language::RUSSIAN;
-        else if (code == "ja") return Language::JAPANESE;
-        else if (code == "zh") return Language::CHINESE;
-        else if (code == "es") return Language::SPANISH;
-        else if (code == "ar") return Language::ARABIC;
-        else if (code == "de") return Language::GERMAN;
-        else if (code == "pt") return Language::PORTUGESE;
-        else if (code == "fr") return Language::FRENCH;
-        else if (code == "hi") return Language::HINDI;
-        else return Language::NONE;
+        const size_t lan = static_cast<size_t>(lang);
+        return itrn::languageHash.codes[lan < LANGUAGE_COUNT ? lan : 0];
     }
 
-    inline void LoadLanguageMap(std::unordered_map<Language, std::string>& map)
+    constexpr Language GetLanguageCodeEnum(std::string_view code) noexcept
     {
-        map[Language::ENGLISH]      = "en";
-        map[Language::RUSSIAN]      = "ru";
-        map[Language::JAPANESE]     = "ja";
-        map[Language::CHINESE]      = "zh";
-        map[Language::SPANISH]      = "es";
-        map[Language::ARABIC]       = "ar";
-        map[Language::GERMAN]       = "de";
-        map[Language::PORTUGESE]    = "pt";
-        map[Language::FRENCH]       = "fr";
-        map[Language::HINDI]        = "hi";
+        // an empty slot holds NONE, whose key no code matches, so there's nothing to branch on
+        const uint64_t key = itrn::PackLanguageCode(code);
+        const uint8_t lan = itrn::languageHash.slots[itrn::HashLanguageCode(key, itrn::languageHash.multiplier)];
+        return static_cast<Language>(itrn::languageHash.keys[lan] == key ? lan : 0);
+    }
+
+    static_assert(GetLanguageCodeEnum("en") == Language::ENGLISH && GetLanguageCodeEnum("pt-BR") == Language::PORTUGESE_BRAZIL);
+    static_assert(GetLanguageCodeEnum("zh-hant") == Language::NONE && GetLanguageCodeEnum("none") == Language::NONE);
+
+    namespace itrn
+    {
+        inline constexpr size_t HEADER_LANGUAGE_WORDS = (LANGUAGE_COUNT + 63) / 64;
+
+        // the languages headers were read for before the table covered all of ISO 639-1, and tags with a subtag
+        consteval std::array<uint64_t, HEADER_LANGUAGE_WORDS> MakeDefaultHeaderLanguages()
+        {
+            std::array<uint64_t, HEADER_LANGUAGE_WORDS> words{};
+            for (size_t lan = 1; lan < LANGUAGE_COUNT; ++lan)
+            {
+                if (lan <= static_cast<size_t>(Language::HINDI) || languageHash.codes[lan].find('-') != std::string_view::npos)
+                    words[lan / 64] |= uint64_t(1) << (lan % 64);
+            }
+            return words;
+        }
+
+        // a bitset can't be atomic, so the set is kept in words the parser reads without a lock
+        struct HeaderLanguages
+        {
+            template<size_t... I>
+            constexpr explicit HeaderLanguages(std::index_sequence<I...>)
+                : words{ MakeDefaultHeaderLanguages()[I]... } {}
+
+            std::array<std::atomic<uint64_t>, HEADER_LANGUAGE_WORDS> words;
+        };
+
+        inline constinit HeaderLanguages headerLanguages{ std::make_index_sequence<HEADER_LANGUAGE_WORDS>() };
+    }
+
+    inline LanguageSet GetHeaderLanguages() noexcept
+    {
+        LanguageSet languages;
+        for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan) languages[lan] = IsHeaderLanguage(static_cast<Language>(lan));
+        return languages;
+    }
+
+    inline void SetHeaderLanguages(const LanguageSet& languages) noexcept
+    {
+        for (size_t w = 0; w < itrn::HEADER_LANGUAGE_WORDS; ++w)
+        {
+            uint64_t word = 0;
+            for (size_t bit = 0; bit < 64 && w * 64 + bit < LANGUAGE_COUNT; ++bit)
+            {
+                // NONE is never a header
+                if (w * 64 + bit != 0 && languages.test(w * 64 + bit)) word |= uint64_t(1) << bit;
+            }
+            itrn::headerLanguages.words[w].store(word, std::memory_order_relaxed);
+        }
     }
 
-    inline void LoadLanguageMap(std::unordered_map<std::string, Language>& map)
+    inline bool IsHeaderLanguage(Language lang) noexcept
     {
-        map["en"] = Language::ENGLISH;
-        map["ru"] = Language::RUSSIAN;
-        map["ja"] = Language::JAPANESE;
-        map["zh"] = Language::CHINESE;
-        map["es"] = Language::SPANISH;
-        map["ar"] = Language::ARABIC;
-        map["de"] = Language::GERMAN;
-        map["pt"] = Language::PORTUGESE;
-        map["fr"] = Language::FRENCH;
-        map["hi"] = Language::HINDI;
+        const size_t lan = static_cast<size_t>(lang);
+        if (lan >= LANGUAGE_COUNT) return false;
+        return (itrn::headerLanguages.words[lan / 64].load(std::memory_order_relaxed) >> (lan % 64)) & 1;
     }
-}
\ No newline at end of file
+}
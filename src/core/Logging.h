@@ -5,32 +5,44 @@
 #include "Types.h"
 #include "Console.h"
 
+#include <mutex>
+
 namespace lg
 {
+    namespace itrn
+    {
+        inline std::mutex outputMutex;  // keeps lines from different threads from mixing
+    }
+
     inline void Output(const String& str)
     {
+        std::scoped_lock lock(itrn::outputMutex);
         con::Print(str);
     }
 
     inline void Debug(const String& str)
     {
         #if _DEBUG
+        std::scoped_lock lock(itrn::outputMutex);
         con::PrintN(con::SetStringColor("[DEBUG]   " + str, con::BLUE, con::NONE));
         #endif
     }
 
     inline void Info(const String& str)
     {
+        std::scoped_lock lock(itrn::outputMutex);
         con::PrintN(con::SetStringColor("[INFO]    " + str, con::GREEN, con::NONE));
     }
 
     inline void Warning(const String& str)
     {
+        std::scoped_lock lock(itrn::outputMutex);
         con::PrintN(con::SetStringColor("[WARNING] " + str, con::BLACK, con::YELLOW));
     }
 
     inline void Error(const String& str)
     {
+        std::scoped_lock lock(itrn::outputMutex);
         con::PrintN(con::SetStringColor("[ERROR]   " + str, con::WHITE, con::RED));
     }
 }
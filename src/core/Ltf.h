@@ -13,9 +13,12 @@
  * You can create an index of a file, which will create a map with position offsets
  * for each ids and corresponding languages. Together with file memory mapping, this 
  * option offers good performance with smaller memory usage (since you don't need to
- * store text itself, it is retrieved at runtime). You can create index either for
- * a specific language (CreateIndex), or for the whole file (CreateIndexAll). 
+ * store text itself, it is retrieved at runtime with GetText). You can create index either for
+ * a specific language and its fallback (CreateIndex), or for the whole file (CreateIndexAll).
+ * Text in other languages is skipped by the parser, so a per-language index costs one language. 
  * You can have 1 index per file. Works well with large files.
+ * For files that shouldn't be mapped at all, CreateIndexStreaming / CreateIndexAllStreaming
+ * read the file through a window of fixed size (CheckLtf only looks for errors that way).
  * 
  * Another option is to parse the file into a simple map where all the ids and 
  * translations are stored. You can either a map for a specific language (CreateMap),
@@ -24,22 +27,39 @@
  * 
  * It's recommended to select one of the options depending on the size of the file
  * (idk why you would want to create both index and map, but whatever floats ig).
- * Note that editing a file invalidates an index / map, and you'll have to re-generate them.
+ * Note that editing a file invalidates an index / map. A map can be re-generated from the
+ * previous one with UpdateMap, which only parses the entries that changed.
  */
 
-#include "Fsm.h"
 #include "Language.h"
 #include "FileHandling.h"
 #include "StringUtil.h"
+#include "CharScan.h"
+#include "Parallel.h"
+#include "FlatMap.h"
+#include "Arena.h"
+#include "Lz.h"
+#include "SharedMemory.h"
 
 #include <optional>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <vector>
-#include <sstream>
+#include <span>
+#include <memory>
 #include <variant>
 #include <filesystem>
-#include <regex>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <ctime>
 
 namespace file
 {
@@ -58,6 +78,7 @@ namespace file
 
         inline const std::string MISSING_ARG = "MISSING_ARGUMENT";
         inline const std::string MISSING_TRANSLATION = "MISSING_TRANSLATION";
+        inline constexpr std::string_view UTF8_BOM = "\xEF\xBB\xBF";
 
         enum class TokenType { ID, LANG, TEXT, INSERT_ID, INSERT_ARG, END_OF_FILE };
 
@@ -88,24 +109,67 @@ namespace file
             }
         };
 
+        // translations of one id. the item list lives in the arena of the LtfFile,
+        // var and text are not copied and have to live at least as long as the arena
         class MultiStr
         {
+        public:
+            struct Item
+            {
+                Language            lan = Language::NONE;
+                std::string_view    var;        // empty for default variation
+                std::string_view    text;
+            };
+
         public:
             MultiStr() = default;
             // for default variation
-            MultiStr(Language ln, const std::string& str) { m_locMap[{ln}] = str; }
-            void Set(Language ln, const std::string& str) { m_locMap[{ln}] = str; }
-            std::string Get(Language ln) { return m_locMap.at({ ln }); }
-
+            void Set(util::Arena& arena, Language ln, std::string_view str) { Set(arena, ln, {}, str); }
             // for custom variation
-            MultiStr(Language ln, const std::string& var, const String& str) { m_locMap[{ln, var}] = str; }
-            void Set(Language ln, const std::string& var, const String& str) { m_locMap[{ln, var}] = str; }
-            std::string Get(Language ln, const std::string& var) { return m_locMap.at({ ln, var }); }
+            void Set(util::Arena& arena, Language ln, std::string_view var, std::string_view str)
+            {
+                for (uint32_t i = 0; i < m_count; ++i)
+                {
+                    if (m_items[i].lan == ln && m_items[i].var == var)
+                    {
+                        m_items[i].text = str;
+                        return;
+                    }
+                }
+
+                // the old list is left in the arena, lists are short so it's not much
+                if (m_count == m_capacity)
+                {
+                    m_capacity = m_capacity ? m_capacity * 2 : 4;
+                    Item* items = arena.AllocateArray<Item>(m_capacity);
+                    std::copy(m_items, m_items + m_count, items);
+                    m_items = items;
+                }
+                m_items[m_count++] = { ln, var, str };
+            }
+
+            std::optional<std::string_view> Find(Language ln, std::string_view var = {}) const
+            {
+                for (uint32_t i = 0; i < m_count; ++i)
+                {
+                    if (m_items[i].lan == ln && m_items[i].var == var) return m_items[i].text;
+                }
+                return std::nullopt;
+            }
+
+            std::string_view Get(Language ln, std::string_view var = {}) const
+            {
+                auto text = Find(ln, var);
+                if (!text) throw exc::CoreException(std::format("No translation for language {}", GetLanguageCodeStr(ln)));
+                return *text;
+            }
 
-            auto& GerStrMap() { return m_locMap; }
+            std::span<const Item> GetItems() const { return { m_items, m_count }; }
 
         private:
-            std::unordered_map<LanguageVariation, String, LanVarHash> m_locMap;
+            Item*       m_items = nullptr;
+            uint32_t    m_count = 0;
+            uint32_t    m_capacity = 0;
         };
 
         using IndexPair = std::pair<uint32_t, uint32_t>;
@@ -120,325 +184,1931 @@ namespace file
             IndexPair Get(Language ln) { return m_indexMap.at({ ln }); }
 
             // for custom variation
-            MultiLocIndex(Language ln, const std::string& var, uint32_t begin, uint32_t end) { m_indexMap[{ln, var}] = { begin,end }; }
-            void Set(Language ln, const std::string& var, uint32_t begin, uint32_t end) { m_indexMap[{ln, var}] = { begin,end }; }
+            MultiLocIndex(Language ln, std::string_view var, uint32_t begin, uint32_t end) { m_indexMap[{ln, String(var)}] = { begin,end }; }
+            void Set(Language ln, std::string_view var, uint32_t begin, uint32_t end) { m_indexMap[{ln, String(var)}] = { begin,end }; }
             IndexPair Get(Language ln, const std::string& var) { return m_indexMap.at({ ln, var }); }
 
             auto& GerIndexMap() { return m_indexMap; }
+            const auto& GerIndexMap() const { return m_indexMap; }
 
         private:
             std::unordered_map<LanguageVariation, IndexPair, LanVarHash> m_indexMap;
         };
 
-        // for ltf parser
-        struct LtfEntryBuilder;
-        const std::regex ltfIdReg("^[A-Za-z0-9_-]+$");
+        // for ltf parser: ids are [A-Za-z0-9_-]+ not starting with a digit and not the code of a header language,
+        // references in inserts are an id, optionally followed by '.' and a variation that doesn't end with '.'.
+        // both are checked by one DFA over character classes, a table lookup per character
+        enum class LtfCharClass : uint8_t { OTHER, DIGIT, WORD, DOT, COUNT };     // WORD: letters, '_' and '-'
+        enum class LtfIdState : uint8_t { START, ID, DOT, VARIATION, REJECT, COUNT };
+
+        inline constexpr auto LTF_CHAR_CLASSES = []
+            {
+                std::array<LtfCharClass, 256> classes{};
+                for (int c = '0'; c <= '9'; ++c) classes[c] = LtfCharClass::DIGIT;
+                for (int c = 'a'; c <= 'z'; ++c) classes[c] = LtfCharClass::WORD;
+                for (int c = 'A'; c <= 'Z'; ++c) classes[c] = LtfCharClass::WORD;
+                classes['_'] = LtfCharClass::WORD;
+                classes['-'] = LtfCharClass::WORD;
+                classes[DOT] = LtfCharClass::DOT;
+                return classes;
+            }();
+
+        // [state * 256 + byte] -> next state. written per class, expanded to bytes so a character is one lookup
+        inline constexpr auto LTF_ID_DFA = []
+            {
+                using enum LtfIdState;
+                constexpr size_t CLASSES = static_cast<size_t>(LtfCharClass::COUNT);
+                std::array<std::array<LtfIdState, CLASSES>, static_cast<size_t>(COUNT)> byClass{};
+                auto set = [&](LtfIdState from, std::array<LtfIdState, CLASSES> to) { byClass[static_cast<size_t>(from)] = to; };
+                //             OTHER      DIGIT      WORD       DOT
+                set(START,     { REJECT,    REJECT,    ID,        REJECT });
+                set(ID,        { REJECT,    ID,        ID,        DOT });
+                set(DOT,       { VARIATION, VARIATION, VARIATION, DOT });
+                set(VARIATION, { VARIATION, VARIATION, VARIATION, DOT });
+                set(REJECT,    { REJECT,    REJECT,    REJECT,    REJECT });
+
+                std::array<LtfIdState, static_cast<size_t>(COUNT) * 256> dfa{};
+                for (size_t state = 0; state < static_cast<size_t>(COUNT); ++state)
+                {
+                    for (size_t c = 0; c < 256; ++c) dfa[state * 256 + c] = byClass[state][static_cast<size_t>(LTF_CHAR_CLASSES[c])];
+                }
+                return dfa;
+            }();
 
-        bool CorrectLtfId(const std::string& id)
+        constexpr LtfIdState RunLtfIdDfa(std::string_view str) noexcept
         {
-            if (id.empty()) return false;
-            if (std::isdigit(id[0])) return false;
-            if (langCodesSL.contains(id)) return false;
+            size_t state = static_cast<size_t>(LtfIdState::START);
+            for (char c : str) state = static_cast<size_t>(LTF_ID_DFA[state * 256 + static_cast<unsigned char>(c)]);
+            return static_cast<LtfIdState>(state);
+        }
 
-            std::smatch match;
-            std::regex_match(id, match, ltfIdReg);
-            if (match.size() != 1) return false;
+        inline bool CorrectLtfId(std::string_view id) noexcept
+        {
+            return RunLtfIdDfa(id) == LtfIdState::ID && !IsHeaderLanguage(GetLanguageCodeEnum(id));
+        }
 
-            return true;
+        // "id" or "id.variation"
+        inline bool CorrectLtfRef(std::string_view ref) noexcept
+        {
+            const LtfIdState state = RunLtfIdDfa(ref);
+            return (state == LtfIdState::ID || state == LtfIdState::VARIATION)
+                && !IsHeaderLanguage(GetLanguageCodeEnum(ref.substr(0, ref.find(DOT))));
         }
 
-        
+        static_assert(RunLtfIdDfa("menu_title-2") == LtfIdState::ID && RunLtfIdDfa("2nd") == LtfIdState::REJECT && RunLtfIdDfa("a.b") == LtfIdState::VARIATION);
+        static_assert(RunLtfIdDfa("a..b c") == LtfIdState::VARIATION && RunLtfIdDfa("item.") == LtfIdState::DOT && RunLtfIdDfa(".plural") == LtfIdState::REJECT);
 
-    }
+        // one translation found by LtfReader
+        // all views point into the parsed source, except for text that had to be
+        // unescaped, which points into the reader's scratch buffer and is only valid
+        // until the callback returns
+        struct LtfSlice
+        {
+            std::string_view    id;
+            std::string_view    var;                // empty for the default variation
+            std::string_view    text;
+            Language            lan = Language::NONE;
+            size_t              begin = 0, end = 0; // offsets of the raw (still escaped) text in the source
+        };
 
-    class LtfFile : public File
-    {
-    public:
-        bool Prepare(const std::filesystem::path& path)
+        // removes escaped new lines (a '\' right before a line break) from raw text
+        inline void LtfUnescape(std::string_view raw, std::string& out)
         {
-            if (Open(path, FileMode::READ))
+            out.clear();
+            for (size_t i = 0; i < raw.size(); ++i)
             {
-                if (Map()) m_ready = true;
+                if (raw[i] == B_SLASH && i + 1 < raw.size())
+                {
+                    if (raw[i + 1] == '\n') { ++i; continue; }
+                    if (raw[i + 1] == '\r' && i + 2 < raw.size() && raw[i + 2] == '\n') { i += 2; continue; }
+
+                    // keep escaped pairs as they are, they are resolved when inserts are processed
+                    out += raw[i];
+                    out += raw[i + 1];
+                    ++i;
+                    continue;
+                }
+                out += raw[i];
             }
-            return false;
         }
-        
-        bool CreateIndex(Language ln)
-        {
-            if (!m_ready) return false;
-            m_locIndex.clear();
 
-        }
+        /*
+         * Inserts ({id}, {id.var}, {}, {n}, {s}, {t}) are compiled into a list of ops.
+         * Literal ops point into the text itself, builtins are turned into literals and
+         * escaped braces / backslashes just split the literal around the '\\'.
+         * References keep the raw "id" or "id.var" in text until the caller resolves them.
+         */
+        enum class InsertOpType : uint8_t { LITERAL, ARG, REF };
 
-        bool CreateIndexAll()
+        struct InsertOp
         {
-            if (!m_ready) return false;
-            m_locIndex.clear();
+            InsertOpType        type = InsertOpType::LITERAL;
+            uint16_t            arg = 0;    // ARG: argument slot, REF: first slot used by the referenced text
+            uint32_t            ref = 0;    // REF: referenced entry, once resolved
+            std::string_view    text;       // LITERAL: the text, REF: "id" or "id.var"
+        };
 
-        }
+        inline constexpr std::string_view BUILTIN_NEW_LINE = "\n";
+        inline constexpr std::string_view BUILTIN_SPACE = " ";
+        inline constexpr std::string_view BUILTIN_TAB = "\t";
 
-        bool CreateMap(Language ln)
+        // compiles text into ops (appended to "ops"), returns the number of positional arguments
+        // references are not resolved. throws exc::CoreException on malformed inserts
+        inline uint16_t CompileInserts(std::string_view text, std::vector<InsertOp>& ops)
         {
-            if (!m_ready) return false;
-            m_locMap.clear();
-            m_Parse(ParseDest::MAP, ln);
+            uint16_t args = 0;
+            size_t literal = 0;     // start of the current literal
+
+            auto flush = [&](size_t end)
+                {
+                    if (end > literal) ops.push_back({ InsertOpType::LITERAL, 0, 0, text.substr(literal, end - literal) });
+                };
+
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                if (text[i] == B_SLASH && i + 1 < text.size()
+                    && (text[i + 1] == O_BRACE || text[i + 1] == C_BRACE || text[i + 1] == B_SLASH))
+                {
+                    flush(i);
+                    literal = ++i;      // keep the escaped char as the start of the next literal
+                    continue;
+                }
+                if (text[i] == C_BRACE) throw exc::CoreException(std::format("LTF insert error: unexpected '}}' at {} in \"{}\"", i, text));
+                if (text[i] != O_BRACE) continue;
+
+                size_t close = text.find(C_BRACE, i + 1);
+                if (close == text.npos) throw exc::CoreException(std::format("LTF insert error: missing '}}' in \"{}\"", text));
+
+                flush(i);
+                std::string_view insert = text.substr(i + 1, close - i - 1);
+                while (!insert.empty() && (insert.front() == ' ' || insert.front() == '\t')) insert.remove_prefix(1);
+                while (!insert.empty() && (insert.back() == ' ' || insert.back() == '\t')) insert.remove_suffix(1);
+
+                if (insert.empty()) ops.push_back({ InsertOpType::ARG, args++, 0, {} });
+                else if (insert == "n") ops.push_back({ InsertOpType::LITERAL, 0, 0, BUILTIN_NEW_LINE });
+                else if (insert == "s") ops.push_back({ InsertOpType::LITERAL, 0, 0, BUILTIN_SPACE });
+                else if (insert == "t") ops.push_back({ InsertOpType::LITERAL, 0, 0, BUILTIN_TAB });
+                else
+                {
+                    if (!CorrectLtfRef(insert))
+                        throw exc::CoreException(std::format("LTF insert error: invalid insert {{{}}} in \"{}\"", insert, text));
+                    ops.push_back({ InsertOpType::REF, 0, 0, insert });
+                }
+
+                i = close;
+                literal = close + 1;
+            }
+            flush(text.size());
+            return args;
         }
 
-        bool CreateMapAll()
+        /*
+         * Single pass parser working directly on the file contents (normally the mapping).
+         * Ids, language codes, variations and text are handed out as string_view slices,
+         * the only copy happens when text contains an escaped new line and has to be rewritten.
+         * 
+         * Text of a language block runs until the next line that starts with '[' or a comment,
+         * surrounding whitespace is trimmed. Escape sequences other than the escaped new line
+         * (\{, \}, \\) are kept in the text, since they only matter for inserts.
+         */
+        class LtfReader
         {
-            if (!m_ready) return false;
-            m_locMap.clear();
+        public:
+            explicit LtfReader(std::string_view src) : m_src(src) {}
 
-        }
+            // parses only [begin, end) of src, which has to start at an entry boundary
+            // (see FindEntryBoundary), positions in slices and errors are still relative to src
+            LtfReader(std::string_view src, size_t begin, size_t end) : m_src(src.substr(0, end)), m_begin(begin) {}
 
-    public:
+            // only translations in these languages are handed out, the rest is skipped (all by default)
+            void SetLanguages(const LanguageSet& languages) { m_languages = languages; }
 
-        std::unordered_map<std::string, itrn::MultiStr>& GetMap() { return m_locMap; }
-        std::unordered_map<std::string, itrn::MultiLocIndex>& GetIndex() { return m_locIndex; }
+            // for a source that is a part of a file: errors report positions and lines from this point on
+            void SetOrigin(size_t pos, size_t line) { m_originPos = pos; m_originLine = line; }
 
-    private:
-        friend struct itrn::LtfEntryBuilder;
-        enum class ParseDest { MAP, INDEX };
+            // calls onSlice(const LtfSlice&) for every translation in the source,
+            // and onEntry(std::string_view id, size_t pos) for every id, pos is the position of its '['
+            // throws exc::CoreException on malformed input
+            template<typename Fn, typename EntryFn = void(*)(std::string_view, size_t)>
+            void Parse(Fn&& onSlice, EntryFn&& onEntry = [](std::string_view, size_t) {})
+            {
+                const std::string_view sv = m_src;
+                size_t i = m_begin;
 
-        bool m_Parse(ParseDest dest, Language ln = Language::NONE)
-        {
-            using namespace itrn;
-            m_entryBuilder.Clear();
-            m_curState = ltfGlobalState;
+                // skip utf-8 BOM
+                if (i == 0 && sv.starts_with(UTF8_BOM)) i = UTF8_BOM.size();
 
-            try
+                while (i < sv.size())
+                {
+                    switch (sv[i])
+                    {
+                    case ' ':
+                    case '\r':
+                    case '\t':
+                    case '\n':
+                        ++i;
+                        break;
+
+                    case F_SLASH:
+                        i = m_SkipComment(i);
+                        break;
+
+                    case O_BRACKET:
+                    {
+                        std::string_view content = m_ReadBracket(i);
+                        if (m_IsLangHeader(content))
+                        {
+                            if (m_id.empty()) m_Throw("language code without an identifier", i);
+
+                            m_headers.clear();
+                            i = m_ReadHeaders(i);
+                            m_idHasText = true;
+
+                            // languages that aren't needed are skipped without looking at the text
+                            bool wanted = false;
+                            for (const auto& header : m_headers) wanted |= m_languages.test(static_cast<size_t>(header.first));
+                            if (!wanted)
+                            {
+                                bool escaped = false;
+                                i = m_FindTextEnd(i, escaped);
+                                break;
+                            }
+
+                            size_t textBegin = 0, textEnd = 0;
+                            bool escaped = false;
+                            i = m_ReadText(i, textBegin, textEnd, escaped);
+
+                            LtfSlice slice;
+                            slice.id = m_id;
+                            slice.begin = textBegin;
+                            slice.end = textEnd;
+                            slice.text = sv.substr(textBegin, textEnd - textBegin);
+                            if (escaped)
+                            {
+                                LtfUnescape(slice.text, m_scratch);
+                                slice.text = m_scratch;
+                            }
+
+                            for (const auto& [lan, var] : m_headers)
+                            {
+                                if (!m_languages.test(static_cast<size_t>(lan))) continue;
+                                slice.lan = lan;
+                                slice.var = var;
+                                onSlice(std::as_const(slice));
+                            }
+                        }
+                        else
+                        {
+                            if (!m_id.empty() && !m_idHasText)
+                                m_Throw(std::format("expected language code after identifier [{}]", m_id), i);
+                            if (!CorrectLtfId(content))
+                                m_Throw(std::format("invalid id [{}]", content), i);
+
+                            m_id = content;
+                            m_idPos = i;
+                            m_idHasText = false;
+                            onEntry(m_id, i);
+                            i = sv.find(C_BRACKET, i) + 1;
+                        }
+                        break;
+                    }
+
+                    default:
+                        m_Throw(std::format("unexpected '{}'", sv[i]), i);
+                    }
+                }
+
+                if (!m_id.empty() && !m_idHasText)
+                    m_Throw(std::format("expected language code after identifier [{}]", m_id), sv.size());
+            }
+
+            /*
+             * Finds the first line after "from" that starts with an [id], so the source can be
+             * split there and both parts parsed separately. Returns the position of the line or npos.
+             * The line can still be inside a block comment, that's not checked here (it would take a scan
+             * from the start), but the part before it then fails with an unterminated comment.
+             */
+            static size_t FindEntryBoundary(std::string_view src, size_t from)
             {
-                std::string contents = GetContent();
-                std::string_view sv(contents);
-                for (size_t i = 0; i < sv.size(); i++)
+                LtfReader reader(src);
+                for (size_t nl = reader.m_Find<'\n'>(from); nl != src.npos; nl = reader.m_Find<'\n'>(nl + 1))
                 {
-                    m_curState->Process(*this, m_entryBuilder, sv, i, dest, ln);
-                    m_entryBuilder.SetValue(dest);
-                    
-                    lg::Debug(std::format("LtfEntryBuilder state:\n- begin: {}\n- end: {}\n- lan: {}\n- id: {}\n- var: {}\n- text: {}",
-                        (void*)m_entryBuilder.begin, (void*)m_entryBuilder.end, lang::GetLanguageCodeStr(m_entryBuilder.lan), m_entryBuilder.id, m_entryBuilder.var, m_entryBuilder.text.str()));
+                    if (reader.m_EscapedLineBreak(nl)) continue;
+                    if (reader.m_EntryLineId(nl + 1)) return nl + 1;
                 }
+                return src.npos;
             }
-            catch (const exc::IException& e)
+
+            // like FindEntryBoundary, but the last such line that starts after "from" and ends before the end of src
+            // (so an entry that may continue past src isn't cut), or npos
+            static size_t FindLastEntryBoundary(std::string_view src, size_t from)
             {
-                lg::Error(e.What());
-                return false;
+                LtfReader reader(src);
+                for (size_t nl = src.rfind('\n'); nl != src.npos && nl >= from; nl = nl > 0 ? src.rfind('\n', nl - 1) : src.npos)
+                {
+                    if (reader.m_EscapedLineBreak(nl)) continue;
+                    if (reader.m_EntryLineId(nl + 1)) return nl + 1;
+                }
+                return src.npos;
             }
-            return true;
-        }
 
-    private:
+            // id of the entry on the line starting at "line" (see FindEntryBoundary, the line break before it isn't checked)
+            static std::optional<std::string_view> GetEntryId(std::string_view src, size_t line)
+            {
+                return LtfReader(src).m_EntryLineId(line);
+            }
 
-        struct LtfEntryBuilder
-        {
-            void Clear()
+        private:
+            static bool m_IsSpace(char c) { return c == ' ' || c == '\t'; }
+
+            // bracket content if the line is "[id]" (with optional spaces) and the id isn't a language code
+            std::optional<std::string_view> m_EntryLineId(size_t line) const
+            {
+                size_t i = line;
+                while (i < m_src.size() && m_IsSpace(m_src[i])) ++i;
+                if (i >= m_src.size() || m_src[i] != O_BRACKET) return std::nullopt;
+
+                size_t close = m_Find<C_BRACKET, '\n'>(i + 1);
+                if (close == m_src.npos || m_src[close] != C_BRACKET) return std::nullopt;
+
+                std::string_view content = m_TrimSpaces(m_src.substr(i + 1, close - i - 1));
+                if (m_IsLangHeader(content)) return std::nullopt;
+                return content;
+            }
+
+            // position of the first of Cs at or after i, or npos
+            template<char... Cs>
+            size_t m_Find(size_t i) const
+            {
+                if (i >= m_src.size()) return m_src.npos;
+                const char* end = m_src.data() + m_src.size();
+                const char* hit = util::FindFirstOf<Cs...>(m_src.data() + i, end);
+                return hit == end ? m_src.npos : static_cast<size_t>(hit - m_src.data());
+            }
+
+            static std::string_view m_TrimSpaces(std::string_view sv)
+            {
+                while (!sv.empty() && m_IsSpace(sv.front())) sv.remove_prefix(1);
+                while (!sv.empty() && m_IsSpace(sv.back())) sv.remove_suffix(1);
+                return sv;
+            }
+
+            static bool m_IsLangHeader(std::string_view content)
             {
-                begin = end = 0;
-                lan = Language::NONE;
-                id.clear();
-                var.clear();
-                text.clear();
+                return content.find(DOT) != content.npos || IsHeaderLanguage(GetLanguageCodeEnum(content));
+            }
 
-                mind.GerIndexMap().clear();
-                mstr.GerStrMap().clear();
+            [[noreturn]] void m_Throw(const std::string& what, size_t pos) const
+            {
+                size_t line = m_originLine + std::count(m_src.begin(), m_src.begin() + std::min(pos, m_src.size()), '\n');
+                throw exc::CoreException(std::format("LTF parsing error: {} at position {} (line {})", what, m_originPos + pos, line));
             }
 
-            void SetValue(ParseDest dest)
+            // i points at '/', returns the position right after the comment
+            size_t m_SkipComment(size_t i)
             {
-                if (id.empty() || text.str().empty()) return;
-                if (dest == ParseDest::MAP)
+                if (i + 1 < m_src.size() && m_src[i + 1] == F_SLASH)
                 {
-                    if (var.empty()) mstr.Set(lan, text.str());
-                    else mstr.Set(lan, var, text.str());
-                    
-                    text.clear();
+                    size_t nl = m_Find<'\n'>(i);
+                    return nl == m_src.npos ? m_src.size() : nl + 1;
                 }
-                else
+                if (i + 1 < m_src.size() && m_src[i + 1] == STAR)
                 {
-                    if (begin != 0 && end != 0)
+                    for (size_t star = m_Find<STAR>(i + 2); star != m_src.npos; star = m_Find<STAR>(star + 1))
                     {
-                        if (var.empty()) mind.Set(lan, begin, end);
-                        else mind.Set(lan, var, begin, end);
-
-                        text.clear(); 
+                        if (star + 1 < m_src.size() && m_src[star + 1] == F_SLASH) return star + 2;
                     }
+                    m_commentPos = i;
+                    m_Throw("unterminated comment", i);
                 }
+                m_Throw("unexpected '/'", i);
+            }
+
+            // i points at '[', returns trimmed content of the brackets (which must close on the same line)
+            std::string_view m_ReadBracket(size_t i) const
+            {
+                size_t close = m_Find<C_BRACKET, '\n'>(i + 1);
+                if (close == m_src.npos || m_src[close] != C_BRACKET) m_Throw("missing ']'", i);
+                return m_TrimSpaces(m_src.substr(i + 1, close - i - 1));
             }
 
-            void RegisterValue(LtfFile& f, ParseDest dest)
+            // reads one or more language headers placed one after another ([en][ru] text),
+            // returns the position right after the last one
+            size_t m_ReadHeaders(size_t i)
             {
-                using namespace itrn;
+                while (true)
+                {
+                    std::string_view content = m_ReadBracket(i);
+                    size_t close = m_src.find(C_BRACKET, i);
 
-                if (dest == ParseDest::MAP) f.m_locMap[id] = mstr;
-                else f.m_locIndex[id] = mind;
+                    std::string_view code = content, var;
+                    if (size_t dot = content.find(DOT); dot != content.npos)
+                    {
+                        code = content.substr(0, dot);
+                        var = content.substr(dot + 1);
+                        if (var.empty()) m_Throw(std::format("invalid language code: {}", content), i);
+                    }
 
-                Clear();
+                    Language lan = GetLanguageCodeEnum(code);
+                    if (lan == Language::NONE) m_Throw(std::format("invalid language code: {}", content), i);
+                    if (!IsHeaderLanguage(lan)) m_Throw(std::format("language {} isn't a header language (see lang::SetHeaderLanguages)", code), i);
+                    m_headers.emplace_back(lan, var);
+
+                    i = close + 1;
+                    size_t next = i;
+                    while (next < m_src.size() && m_IsSpace(m_src[next])) ++next;
+                    if (next >= m_src.size() || m_src[next] != O_BRACKET || !m_IsLangHeader(m_ReadBracket(next)))
+                        return i;
+                    i = next;
+                }
             }
 
-            bool readyMind = false;
-            bool readyMstr = false;
-
-            uint32_t begin, end;
-            Language lan;
-            std::string id, var;
-            std::stringstream text;
-            
-            itrn::MultiLocIndex mind;
-            itrn::MultiStr mstr;
-        };
+            // true if the line break at nl (position of '\n') is escaped with an odd number of '\'
+            bool m_EscapedLineBreak(size_t nl) const
+            {
+                size_t j = nl;
+                if (j > 0 && m_src[j - 1] == '\r') --j;
+                size_t slashes = 0;
+                while (j > 0 && m_src[j - 1] == B_SLASH) { --j; ++slashes; }
+                return slashes % 2 == 1;
+            }
 
-        struct LtfParserState
-        {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) = 0;
-        };
+            // true if a line starting at i ends a text block (starts with '[' or a comment)
+            bool m_EndsText(size_t i) const
+            {
+                while (i < m_src.size() && (m_IsSpace(m_src[i]) || m_src[i] == '\r')) ++i;
+                if (i >= m_src.size()) return false;
+                if (m_src[i] == O_BRACKET) return true;
+                return m_src[i] == F_SLASH && i + 1 < m_src.size() && (m_src[i + 1] == F_SLASH || m_src[i + 1] == STAR);
+            }
 
-        struct LtfGlobalState : public LtfParserState
-        {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) override
+            // returns the position where text starting at i ends (the start of the line that ends it)
+            size_t m_FindTextEnd(size_t i, bool& escaped) const
             {
-                switch (sv[i])
-                {
-                case '/':
-                {
-                    if (sv[i + 1] == '/') i = sv.substr(i).find_first_of('\n');       // one line comment
-                    else if (sv[i + 1] == '*') owner.m_curState = owner.ltfCommentState;   // multi line comment
-                    else throw exc::CoreException(std::format("LTF parsing error: unexpected '/' at position {}", i));
-                    break;
-                }
-                case '[':
+                // text is skipped line by line, only line starts need a closer look
+                for (size_t nl = m_Find<'\n'>(i); nl != m_src.npos; nl = m_Find<'\n'>(nl + 1))
                 {
-                    std::string val(sv.substr(i + 1, sv.substr(i).find_first_of(']') - 1));
-                    val = util::Trim(val);
-                    if (val.find('.') != val.npos || lang::langCodesSL.contains(val)) owner.m_curState = owner.ltfLangState;
-                    else owner.m_curState = owner.ltfIdState;
-                    break;
+                    if (m_EscapedLineBreak(nl))
+                    {
+                        escaped = true;
+                        continue;
+                    }
+                    if (m_EndsText(nl + 1)) return nl + 1;
                 }
-                case ' ':
-                case '\r':
-                case '\t':
-                case '\n':
-                    owner.m_curState = owner.ltfGlobalState;
-                    break;
+                return m_src.size();
+            }
 
-                default:
-                    throw exc::CoreException(std::format("LTF parsing error: unexpected '{}' at position {}", sv[i], i));
-                    break;
+            // reads text starting at i (right after the language headers), returns the position
+            // where parsing continues and sets [begin, end) to the trimmed raw text
+            size_t m_ReadText(size_t i, size_t& begin, size_t& end, bool& escaped) const
+            {
+                size_t stop = m_FindTextEnd(i, escaped);
+
+                auto isWs = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+                begin = i;
+                end = stop;
+                while (begin < end && isWs(m_src[begin])) ++begin;
+                while (end > begin && isWs(m_src[end - 1]))
+                {
+                    // a trailing escaped line break belongs to the text
+                    if (m_src[end - 1] == '\n' && m_EscapedLineBreak(end - 1)) break;
+                    --end;
                 }
+                return stop;
             }
+
+        private:
+            std::string_view                                    m_src;
+            size_t                                              m_begin = 0;
+            LanguageSet                                         m_languages = LanguageSet().set();
+            std::vector<std::pair<Language, std::string_view>>  m_headers;  // languages sharing the current text
+            std::string                                         m_scratch;  // holds unescaped text
+
+            // the entry being parsed, kept in members so LtfStreamReader can continue it in another window
+            std::string_view                                    m_id;
+            size_t                                              m_idPos = 0;            // of its '['
+            bool                                                m_idHasText = false;
+            size_t                                              m_commentPos = std::string_view::npos;  // of an unterminated comment
+
+            size_t                                              m_originPos = 0;
+            size_t                                              m_originLine = 1;
+
+            friend class LtfStreamReader;
         };
 
-        struct LtfIdState : public LtfParserState
+        /*
+         * Parses a file through a window instead of a mapping, for files that shouldn't be kept in memory
+         * (validating or indexing huge tables). Blocks of the file are read ahead by a separate thread,
+         * every window is parsed up to its last complete entry and the rest is carried over to the next one,
+         * so entries (and comments) that cross blocks are parsed whole. Memory use is two blocks plus the
+         * window, which only grows past two blocks for an entry or a comment that big.
+         */
+        class LtfStreamReader
         {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) override
-            {
-                using namespace itrn;
+        public:
+            static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+            static constexpr size_t MIN_BLOCK_SIZE = 4 * 1024;
+
+            explicit LtfStreamReader(const std::filesystem::path& path, size_t blockSize = DEFAULT_BLOCK_SIZE)
+                : m_path(path), m_blockSize(std::max(blockSize, MIN_BLOCK_SIZE)) {}
 
-                if (!bld.id.empty())
+            void SetLanguages(const LanguageSet& languages) { m_languages = languages; }
+
+            // like LtfReader::Parse, but positions (of entries and slices) are offsets in the file
+            // and all views are only valid until the callback returns
+            template<typename Fn, typename EntryFn = void(*)(std::string_view, size_t)>
+            void Parse(Fn&& onSlice, EntryFn&& onEntry = [](std::string_view, size_t) {})
+            {
+                BlockReader blocks(m_path, m_blockSize);
+                std::string window;                         // the part of the file that isn't parsed yet
+                window.reserve(2 * m_blockSize);
+                size_t windowPos = 0, windowLine = 1;       // of window[0] in the file
+
+                // an entry interrupted by a comment that didn't end in the window is continued in the next one:
+                // window[0] is then the '[' of its id and parsing goes on at "skip", where the comment starts
+                size_t skip = 0;
+                bool resume = false;
+                size_t idBegin = 0, idSize = 0;
+                bool idHasText = false;
+
+                for (bool end = false; !end;)
                 {
-                    // if there's id and text or indices, then we're ready to register
-                    if (!bld.text.str().empty() || !(bld.begin == 0 && bld.end == 0))
+                    const std::string_view block = blocks.Next();
+                    end = block.empty();
+                    window.append(block);
+                    m_peakWindow = std::max(m_peakWindow, window.capacity());
+
+                    // the last entry may go on in the next block
+                    const size_t cut = end ? window.size() : LtfReader::FindLastEntryBoundary(window, skip);
+                    if (cut == window.npos) continue;
+
+                    LtfReader reader(window, skip, cut);
+                    reader.SetLanguages(m_languages);
+                    reader.SetOrigin(windowPos, windowLine);
+                    if (resume)
                     {
-                        bld.RegisterValue(owner, dest);
-                        owner.m_curState = owner.ltfGlobalState;
+                        reader.m_id = std::string_view(window).substr(idBegin, idSize);
+                        reader.m_idHasText = idHasText;
                     }
-                    // if there's id but nothing else, then the entry is incorrect
-                    else throw exc::CoreException(std::format("LTF parsing error: expected language code after identifier [{}]", bld.id));
 
-                    return;
-                }
+                    size_t keep = cut;      // where the next window starts
+                    try
+                    {
+                        reader.Parse([&](const LtfSlice& slice)
+                            {
+                                LtfSlice inFile = slice;
+                                inFile.begin += windowPos;
+                                inFile.end += windowPos;
+                                onSlice(std::as_const(inFile));
+                            },
+                            [&](std::string_view id, size_t pos) { onEntry(id, windowPos + pos); });
+                        resume = false;
+                        skip = 0;
+                    }
+                    catch (const exc::IException&)
+                    {
+                        // the cut was a line inside a comment. everything before the comment is done,
+                        // so the next window starts at the current entry (or the comment, if there's none)
+                        if (end || reader.m_commentPos == std::string_view::npos) throw;
+
+                        resume = !reader.m_id.empty();
+                        keep = resume ? reader.m_idPos : reader.m_commentPos;
+                        if (resume)
+                        {
+                            idBegin = static_cast<size_t>(reader.m_id.data() - window.data()) - keep;
+                            idSize = reader.m_id.size();
+                            idHasText = reader.m_idHasText;
+                        }
+                        skip = reader.m_commentPos - keep;
+                    }
 
-                size_t idEnd = sv.substr(i).find_first_of(']');
-                std::string id(sv.substr(i, idEnd));
-                if (!CorrectLtfId(id)) throw exc::CoreException(std::format("LTF parsing error: invalid id [{}]", id));
-                else
-                {
-                    bld.id = id;
-                    i += idEnd;
-                    owner.m_curState = owner.ltfGlobalState;
+                    windowLine += std::count(window.begin(), window.begin() + keep, '\n');
+                    windowPos += keep;
+                    window.erase(0, keep);
                 }
             }
+
+            // buffers used by the last Parse at most (read ahead blocks and the window)
+            size_t GetPeakMemory() const { return 2 * m_blockSize + m_peakWindow; }
+
+        private:
+            std::filesystem::path   m_path;
+            size_t                  m_blockSize;
+            LanguageSet             m_languages = LanguageSet().set();
+            size_t                  m_peakWindow = 0;
         };
 
-        struct LtfLangState : public LtfParserState
+        using StatsClock = std::chrono::steady_clock;
+
+        inline double SecondsSince(StatsClock::time_point begin)
+        {
+            return std::chrono::duration<double>(StatsClock::now() - begin).count();
+        }
+
+        // heap memory of a string, 0 if it fits into the string itself
+        inline size_t StringHeapBytes(const std::string& str)
         {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) override
+            return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+        }
+    }
+
+    // what a loaded file costs, to pick between map and index mode (or a compiled file) by numbers
+    struct LtfStats
+    {
+        size_t  mappedBytes = 0;        // of the file, or the shared memory image
+        size_t  residentBytes = 0;      // of the mapping, in memory right now (0 where that can't be told)
+        size_t  mapBytes = 0;           // heap used by the map: table, ids, arenas with the text
+        size_t  indexBytes = 0;         // heap used by the index, estimated (node containers don't tell)
+        size_t  cacheBytes = 0;         // decoded text of compressed .ltfb files
+        size_t  entries = 0;            // ids, of the map if there's one, else of the index
+        std::array<size_t, LANGUAGE_COUNT> texts{};    // translations per language, variations included
+        double  parseSeconds = 0;       // last CreateMap* / UpdateMap, or Prepare of an .ltfb
+        double  indexSeconds = 0;       // last CreateIndex*
+
+        size_t GetHeapBytes() const { return mapBytes + indexBytes + cacheBytes; }
+    };
+
+    class LtfFile : public File
+    {
+    public:
+        bool Prepare(const std::filesystem::path& path)
+        {
+            if (Open(path, FileMode::READ))
             {
-                size_t lanEnd = sv.substr(i).find_first_of(']');
-                std::string lan(sv.substr(i, lanEnd));
-                if (lan.empty() || !lang::langCodesSL.contains(lan))
-                    throw exc::CoreException(std::format("LTF parsing error: invalid language code: {}", lan));
+                if (Map()) m_ready = true;
+            }
+            return m_ready;
+        }
+        
+        // only ln and the fallback language are stored, text in other languages is skipped
+        // (pass Language::NONE as fallback to store just ln)
+        bool CreateIndex(Language ln, Language fallback = Language::ENGLISH)
+        {
+            if (!m_ready) return false;
+            m_locIndex.clear();
+            return m_Parse(ParseDest::INDEX, m_LanguagesOf(ln, fallback));
+        }
 
-                std::string code, var;
-                if (lan.find('.') != lan.npos)
-                {
-                    size_t dot = lan.find_first_of('.');
-                    code = lan.substr(0, dot);
-                    var = lan.substr(dot + 1);
+        bool CreateIndexAll()
+        {
+            if (!m_ready) return false;
+            m_locIndex.clear();
+            return m_Parse(ParseDest::INDEX, LanguageSet().set());
+        }
 
-                    if (code.empty() || !lang::langCodesSL.contains(code))
-                        throw exc::CoreException(std::format("LTF parsing error: invalid language code: {}", lan));
-                    if (var.empty()) throw exc::CoreException(std::format("LTF parsing error: invalid language code: {}", lan));
+        // like CreateIndex / CreateIndexAll, but the file is read through a window (see LtfStreamReader)
+        // instead of being mapped, so memory use doesn't grow with the size of the file.
+        // the file doesn't have to be Prepared, GetText needs it to be though
+        bool CreateIndexStreaming(const std::filesystem::path& path, Language ln, Language fallback = Language::ENGLISH,
+            size_t blockSize = itrn::LtfStreamReader::DEFAULT_BLOCK_SIZE)
+        {
+            return m_StreamIndex(path, m_LanguagesOf(ln, fallback), blockSize);
+        }
 
-                    bld.lan = lang::GetLanguageCodeEnum(code);
-                    bld.var = var;
-                }
+        bool CreateIndexAllStreaming(const std::filesystem::path& path, size_t blockSize = itrn::LtfStreamReader::DEFAULT_BLOCK_SIZE)
+        {
+            return m_StreamIndex(path, LanguageSet().set(), blockSize);
+        }
 
-                i += lanEnd;
-                bld.lan = lang::GetLanguageCodeEnum(lan);
+        bool CreateMap(Language ln, Language fallback = Language::ENGLISH)
+        {
+            if (!m_ready) return false;
+            m_ResetMap();
+            return m_Parse(ParseDest::MAP, m_LanguagesOf(ln, fallback));
+        }
 
-                owner.m_curState = owner.ltfTextState;
-            }
-        };
+        bool CreateMapAll()
+        {
+            if (!m_ready) return false;
+            m_ResetMap();
+            return m_Parse(ParseDest::MAP, LanguageSet().set());
+        }
 
-        struct LtfTextState : public LtfParserState
+        // creates the map again after the file changed on disk (Prepare the new version first),
+        // with the languages "previous" was created with. entries whose bytes didn't change are
+        // taken over from "previous" (their text is shared, not copied), only the rest is parsed
+        bool UpdateMap(const LtfFile& previous)
         {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) override
+            if (!m_ready) return false;
+            const auto begin = itrn::StatsClock::now();
+            m_ResetMap();
+            if (!previous.m_incremental) return m_Parse(ParseDest::MAP, previous.m_mapLanguages);
+
+            try
             {
+                const std::string_view sv = GetView();
+                std::vector<EntryPos> entries = m_FindEntries();
+                m_HashEntries(entries);
+                m_mapLanguages = previous.m_mapLanguages;
+                m_parsedEntries = 0;
+
+                auto changed = [&](std::string_view id)
+                    {
+                        auto prevHash = previous.m_entryHashes.find(id);
+                        return prevHash == previous.m_entryHashes.end() || prevHash->second != m_entryHashes.at(id);
+                    };
+
+                m_locMap = previous.m_locMap;
+                m_olderArenas = previous.m_olderArenas;
+                m_olderArenas.push_back(previous.m_arena);
+
+                // removed and changed ids are dropped, changed ones are parsed again below
+                // (into our own arena, item lists in older arenas are never written to)
+                for (const auto& [id, mstr] : previous.m_locMap)
+                {
+                    if (!m_entryHashes.contains(id) || changed(id)) m_locMap.erase(id);
+                }
 
-                if (sv[i] == '\n' && sv[i - 1] != '\\')
+                for (size_t e = 0; e < entries.size(); ++e)
                 {
-                    owner.m_curState = owner.ltfGlobalState;
-                    return;
+                    if (!changed(entries[e].id)) continue;
+
+                    size_t end = e + 1 < entries.size() ? entries[e + 1].begin : sv.size();
+                    m_ParseRange(entries[e].begin, end, ParseDest::MAP, m_mapLanguages, m_locMap, m_locIndex, *m_arena, nullptr);
+                    if (!entries[e].id.empty()) ++m_parsedEntries;
                 }
 
-                bld.text << sv[i];
-                owner.m_curState = owner.ltfTextState;
+                if (m_olderArenas.size() > MAX_ARENA_GENERATIONS) m_CompactMap();
             }
-        };
+            catch (const exc::IException&)
+            {
+                // an entry parsed on its own can fail when a new comment hides an id,
+                // the full parse sorts that out (or reports the real error)
+                m_ResetMap();
+                return m_Parse(ParseDest::MAP, previous.m_mapLanguages);
+            }
+            m_parseSeconds = itrn::SecondsSince(begin);
+            return true;
+        }
+
+        // entries parsed by the last CreateMap / UpdateMap
+        size_t GetParsedEntryCount() const { return m_parsedEntries; }
 
-        struct LtfCommentState : public LtfParserState
+        // threads used to parse a single large file (split at entry boundaries), 0 to use all cores
+        void SetParseThreads(size_t count) { m_parseThreads = count; }
+
+        // memory of the mapping, the map and the index, what's in them and how long building them took.
+        // walks every entry, so it's not meant for every frame
+        LtfStats GetStats() const
         {
-            virtual void Process(LtfFile& owner, LtfEntryBuilder& bld, std::string_view sv, size_t& i, ParseDest dest, Language ln = Language::NONE) override
+            using namespace itrn;
+
+            LtfStats stats;
+            stats.mappedBytes = m_ready ? GetSize() : 0;
+            stats.residentBytes = m_ready ? GetResidentBytes() : 0;
+            stats.parseSeconds = m_parseSeconds;
+            stats.indexSeconds = m_indexSeconds;
+
+            // arenas shared with other versions (UpdateMap) are counted in each of them
+            stats.mapBytes = m_locMap.allocated_bytes() + m_entryHashes.allocated_bytes() + m_arena->GetReserved();
+            for (const auto& arena : m_olderArenas) stats.mapBytes += arena->GetReserved();
+            for (const auto& [id, hash] : m_entryHashes) stats.mapBytes += StringHeapBytes(id);
+            for (const auto& [id, mstr] : m_locMap) stats.mapBytes += StringHeapBytes(id);
+
+            // a node per translation plus the bucket array, for every id
+            using IndexNode = std::pair<const LanguageVariation, IndexPair>;
+            stats.indexBytes = m_locIndex.allocated_bytes();
+            for (const auto& [id, mind] : m_locIndex)
             {
-                for (size_t j = i; j < (sv.size() - i); ++j)
-                {
-                    if (sv[j] == '/' && sv[j - 1] == '*')
-                    {
-                        i = j;
-                        break;
-                    }
-                }
+                const auto& inner = mind.GerIndexMap();
+                stats.indexBytes += StringHeapBytes(id) + inner.bucket_count() * sizeof(void*) + inner.size() * (sizeof(IndexNode) + 2 * sizeof(void*));
+                for (const auto& [lanVar, pos] : inner) stats.indexBytes += lanVar.var ? StringHeapBytes(*lanVar.var) : 0;
+            }
 
-                owner.m_curState = owner.ltfGlobalState;
+            if (!m_locMap.empty())
+            {
+                stats.entries = m_locMap.size();
+                for (const auto& [id, mstr] : m_locMap)
+                    for (const auto& item : mstr.GetItems()) ++stats.texts[static_cast<size_t>(item.lan)];
             }
-        };
-        
+            else
+            {
+                stats.entries = m_locIndex.size();
+                for (const auto& [id, mind] : m_locIndex)
+                    for (const auto& [lanVar, pos] : mind.GerIndexMap()) ++stats.texts[static_cast<size_t>(lanVar.lan)];
+            }
+            return stats;
+        }
 
-    private:
-        std::shared_ptr<LtfGlobalState> ltfGlobalState = std::make_shared<LtfGlobalState>();
-        std::shared_ptr<LtfCommentState> ltfCommentState = std::make_shared<LtfCommentState>();
-        std::shared_ptr<LtfTextState> ltfTextState = std::make_shared<LtfTextState>();
-        std::shared_ptr<LtfLangState> ltfLangState = std::make_shared<LtfLangState>();
-        std::shared_ptr<LtfIdState> ltfIdState = std::make_shared<LtfIdState>();
+        // retrieves text for an index entry from the mapping
+        String GetText(const itrn::IndexPair& ind) const
+        {
+            std::string_view raw = GetView().substr(ind.first, ind.second - ind.first);
+            if (raw.find(itrn::B_SLASH) == raw.npos) return String(raw);
 
-    private:
-        bool                              m_ready = false;
+            String text;
+            itrn::LtfUnescape(raw, text);
+            return text;
+        }
 
-        LtfEntryBuilder                   m_entryBuilder;
-        std::shared_ptr<LtfParserState>   m_curState;
+    public:
+
+        using LocMap = util::FlatMap<std::string, itrn::MultiStr>;
+        using LocIndex = util::FlatMap<std::string, itrn::MultiLocIndex>;
 
-        std::unordered_map<std::string, itrn::MultiStr>      m_locMap;
-        std::unordered_map<std::string, itrn::MultiLocIndex> m_locIndex;
+        LocMap& GetMap() { return m_locMap; }
+        LocIndex& GetIndex() { return m_locIndex; }
+        const LocMap& GetMap() const { return m_locMap; }
+        const LocIndex& GetIndex() const { return m_locIndex; }
+        const util::Arena& GetArena() const { return *m_arena; }    // text of the map, without text shared with previous versions
+
+    private:
+        enum class ParseDest { MAP, INDEX };
+
+        static constexpr size_t PARALLEL_MIN_CHUNK = 4 * 1024 * 1024;    // smaller files (or chunks) aren't worth the threads
+        static constexpr size_t UNALIGNED_ENTRY = SIZE_MAX;
+        static constexpr size_t MAX_ARENA_GENERATIONS = 8;      // UpdateMap moves all text into one arena after this many
+
+        void m_ResetMap()
+        {
+            m_locMap.clear();
+            m_arena = std::make_shared<util::Arena>();
+            m_olderArenas.clear();
+        }
+
+        // copies all text into a new arena, so text of entries that changed long ago is freed
+        void m_CompactMap()
+        {
+            auto arena = std::make_shared<util::Arena>();
+            for (auto& [id, mstr] : m_locMap)
+            {
+                itrn::MultiStr copy;
+                for (const auto& item : mstr.GetItems()) copy.Set(*arena, item.lan, arena->Store(item.var), arena->Store(item.text));
+                mstr = copy;
+            }
+            m_arena = std::move(arena);
+            m_olderArenas.clear();
+        }
+
+        // where an id starts, its entry runs to the next one.
+        // the first one (empty id) covers everything before the first id
+        struct EntryPos
+        {
+            std::string_view    id;
+            size_t              begin = 0;
+        };
+
+        static LanguageSet m_LanguagesOf(Language ln, Language fallback)
+        {
+            LanguageSet languages;
+            languages.set(static_cast<size_t>(ln));
+            if (fallback != Language::NONE) languages.set(static_cast<size_t>(fallback));
+            return languages;
+        }
+
+        bool m_Parse(ParseDest dest, const LanguageSet& languages)
+        {
+            const auto begin = itrn::StatsClock::now();
+
+            // positions of the ids are kept for UpdateMap
+            std::vector<EntryPos> entries{ EntryPos{} };
+            std::vector<EntryPos>* entriesPtr = dest == ParseDest::MAP ? &entries : nullptr;
+
+            try
+            {
+                std::vector<size_t> bounds = m_SplitIntoChunks();
+                if (bounds.size() <= 2)
+                {
+                    m_ParseRange(0, GetSize(), dest, languages, m_locMap, m_locIndex, *m_arena, entriesPtr);
+                }
+                else
+                {
+                    // chunks are parsed into their own maps and merged in order, so later
+                    // entries override earlier ones just like in a single pass
+                    const size_t chunks = bounds.size() - 1;
+                    std::vector<LocMap> maps(chunks);
+                    std::vector<LocIndex> indices(chunks);
+                    std::vector<util::Arena> arenas(chunks);
+                    std::vector<std::vector<EntryPos>> chunkEntries(chunks);
+                    std::vector<uint8_t> failed(chunks, 0);
+                    util::ParallelFor(chunks, m_parseThreads, [&](size_t c)
+                        {
+                            try
+                            {
+                                m_ParseRange(bounds[c], bounds[c + 1], dest, languages, maps[c], indices[c], arenas[c],
+                                    entriesPtr ? &chunkEntries[c] : nullptr);
+                            }
+                            catch (...)     // ParallelFor workers must not throw, bad_alloc included
+                            {
+                                failed[c] = 1;
+                            }
+                        });
+
+                    // a split inside a comment, or a real error: parse again in one pass,
+                    // which reports the same error (and position) as without splitting,
+                    // and throws anything else on the calling thread
+                    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+                    {
+                        m_ResetMap();
+                        m_locIndex.clear();
+                        m_ParseRange(0, GetSize(), dest, languages, m_locMap, m_locIndex, *m_arena, entriesPtr);
+                    }
+                    else
+                    {
+                        for (auto& arena : arenas) m_arena->Splice(arena);
+                        for (size_t c = 0; c < chunks; ++c)
+                        {
+                            if (dest == ParseDest::MAP) m_Merge(m_locMap, maps[c], *m_arena);
+                            else m_Merge(m_locIndex, indices[c]);
+                            entries.insert(entries.end(), chunkEntries[c].begin(), chunkEntries[c].end());
+                        }
+                    }
+                }
+            }
+            catch (const exc::IException& e)
+            {
+                if (dest == ParseDest::MAP) m_incremental = false;
+                lg::Error(e.What());
+                return false;
+            }
+
+            if (dest == ParseDest::MAP)
+            {
+                m_mapLanguages = languages;
+                m_parsedEntries = entries.size() - 1;
+                m_HashEntries(entries);
+                m_parseSeconds = itrn::SecondsSince(begin);
+            }
+            else m_indexSeconds = itrn::SecondsSince(begin);
+            return true;
+        }
+
+        // ids in the file as found by FindEntryBoundary, without parsing
+        std::vector<EntryPos> m_FindEntries() const
+        {
+            const std::string_view sv = GetView();
+            std::vector<EntryPos> entries{ EntryPos{} };
+
+            // an id on the first line has no line break before it
+            const size_t first = sv.starts_with(itrn::UTF8_BOM) ? itrn::UTF8_BOM.size() : 0;
+            if (auto id = itrn::LtfReader::GetEntryId(sv, first)) entries.push_back({ *id, first });
+
+            for (size_t b = itrn::LtfReader::FindEntryBoundary(sv, first); b != sv.npos; b = itrn::LtfReader::FindEntryBoundary(sv, b))
+                entries.push_back({ *itrn::LtfReader::GetEntryId(sv, b), b });
+            return entries;
+        }
+
+        // start of the line of an id at pos, the same position m_FindEntries would give, or UNALIGNED_ENTRY
+        size_t m_EntryLineStart(size_t pos) const
+        {
+            const std::string_view sv = GetView();
+            size_t line = pos;
+            while (line > 0 && (sv[line - 1] == ' ' || sv[line - 1] == '\t')) --line;
+
+            if (line == 0 || (line == itrn::UTF8_BOM.size() && sv.starts_with(itrn::UTF8_BOM))) return line;
+            if (itrn::LtfReader::FindEntryBoundary(sv, line - 1) == line) return line;
+            return UNALIGNED_ENTRY;     // e.g. after a comment on the same line
+        }
+
+        // hashes the bytes of every id's entries (an entry runs to the next one)
+        void m_HashEntries(const std::vector<EntryPos>& entries)
+        {
+            m_entryHashes.clear();
+            m_incremental = std::none_of(entries.begin(), entries.end(), [](const EntryPos& e) { return e.begin == UNALIGNED_ENTRY; });
+            if (!m_incremental) return;
+
+            const std::string_view sv = GetView();
+            m_entryHashes.reserve(entries.size());
+            for (size_t e = 0; e < entries.size(); ++e)
+            {
+                size_t end = e + 1 < entries.size() ? entries[e + 1].begin : sv.size();
+                uint64_t& hash = m_entryHashes[entries[e].id];
+                hash = util::Mix64(hash ^ std::hash<std::string_view>{}(sv.substr(entries[e].begin, end - entries[e].begin)));
+            }
+        }
+
+        bool m_StreamIndex(const std::filesystem::path& path, const LanguageSet& languages, size_t blockSize)
+        {
+            const auto begin = itrn::StatsClock::now();
+            m_locIndex.clear();
+            try
+            {
+                itrn::LtfStreamReader reader(path, blockSize);
+                reader.SetLanguages(languages);
+
+                // translations always follow their id, so the destination is looked up once per entry
+                itrn::MultiLocIndex* mind = nullptr;
+                reader.Parse([&](const itrn::LtfSlice& slice)
+                    {
+                        if (slice.end > UINT32_MAX)
+                            throw exc::CoreException(std::format("{} is too large to be indexed (positions are 32 bit)", path.string()));
+
+                        const auto textBegin = static_cast<uint32_t>(slice.begin), textEnd = static_cast<uint32_t>(slice.end);
+                        if (slice.var.empty()) mind->Set(slice.lan, textBegin, textEnd);
+                        else mind->Set(slice.lan, slice.var, textBegin, textEnd);
+                    },
+                    [&](std::string_view id, size_t) { mind = &m_locIndex[id]; });
+            }
+            catch (const exc::IException& e)
+            {
+                m_locIndex.clear();
+                lg::Error(e.What());
+                return false;
+            }
+            m_indexSeconds = itrn::SecondsSince(begin);
+            return true;
+        }
+
+        // bounds of chunks to parse in parallel: [0, b1, b2, ..., size]
+        std::vector<size_t> m_SplitIntoChunks() const
+        {
+            std::vector<size_t> bounds{ 0 };
+            const size_t size = GetSize();
+            const size_t threads = util::GetThreadCount(m_parseThreads);
+            if (threads > 1 && size >= 2 * PARALLEL_MIN_CHUNK)
+            {
+                // a few chunks per thread, to even out uneven chunks
+                const size_t chunk = std::max(PARALLEL_MIN_CHUNK, size / (threads * 4));
+                const std::string_view sv = GetView();
+                for (size_t b = itrn::LtfReader::FindEntryBoundary(sv, chunk); b != sv.npos && b + chunk / 2 < size;
+                    b = itrn::LtfReader::FindEntryBoundary(sv, b + chunk))
+                {
+                    bounds.push_back(b);
+                }
+            }
+            bounds.push_back(size);
+            return bounds;
+        }
+
+        // the text of map entries is copied into "arena", positions of ids are added to "entries" (if not null)
+        void m_ParseRange(size_t begin, size_t end, ParseDest dest, const LanguageSet& languages,
+            LocMap& locMap, LocIndex& locIndex, util::Arena& arena, std::vector<EntryPos>* entries) const
+        {
+            using namespace itrn;
+
+            // entries of the same id come one after another, so the
+            // destination is only looked up when the id changes
+            const char* curId = nullptr;
+            MultiStr* mstr = nullptr;
+            MultiLocIndex* mind = nullptr;
+
+            LtfReader reader(GetView(), begin, end);
+            reader.SetLanguages(languages);
+            reader.Parse([&](const LtfSlice& slice)
+                {
+                    if (slice.id.data() != curId)
+                    {
+                        curId = slice.id.data();
+                        if (dest == ParseDest::MAP) mstr = &locMap[slice.id];
+                        else mind = &locIndex[slice.id];
+                    }
+
+                    if (dest == ParseDest::MAP)
+                    {
+                        mstr->Set(arena, slice.lan, arena.Store(slice.var), arena.Store(slice.text));
+                    }
+                    else
+                    {
+                        if (slice.end > UINT32_MAX)
+                            throw exc::CoreException("The file is too large to be indexed (positions are 32 bit)");
+
+                        const auto textBegin = static_cast<uint32_t>(slice.begin), textEnd = static_cast<uint32_t>(slice.end);
+                        if (slice.var.empty()) mind->Set(slice.lan, textBegin, textEnd);
+                        else mind->Set(slice.lan, slice.var, textBegin, textEnd);
+                    }
+                },
+                [&](std::string_view id, size_t pos)
+                {
+                    if (entries) entries->push_back({ id, m_EntryLineStart(pos) });
+                });
+        }
+
+        // moves entries of "from" into "to", translations from "from" win
+        static void m_Merge(LocMap& to, LocMap& from, util::Arena& arena)
+        {
+            for (auto& [id, mstr] : from)
+            {
+                auto [it, added] = to.try_emplace(std::move(id), mstr);
+                if (added) continue;
+
+                for (const auto& item : mstr.GetItems()) it->second.Set(arena, item.lan, item.var, item.text);
+            }
+        }
+
+        static void m_Merge(LocIndex& to, LocIndex& from)
+        {
+            for (auto& [id, mind] : from)
+            {
+                auto [it, added] = to.try_emplace(std::move(id), std::move(mind));
+                if (added) continue;
+
+                auto& inner = it->second.GerIndexMap();
+                for (auto& [lanVar, v] : mind.GerIndexMap()) inner[lanVar] = v;
+            }
+        }
+
+    private:
+        bool                              m_ready = false;
+        size_t                            m_parseThreads = 1;
+
+        LocMap                            m_locMap;
+        LocIndex                          m_locIndex;
+        // text of m_locMap. arenas are shared with newer versions made by UpdateMap, so they are replaced, never cleared
+        std::shared_ptr<util::Arena>                m_arena = std::make_shared<util::Arena>();
+        std::vector<std::shared_ptr<util::Arena>>   m_olderArenas;      // text taken over from previous versions
+
+        // for UpdateMap
+        LanguageSet                             m_mapLanguages;
+        util::FlatMap<std::string, uint64_t>    m_entryHashes;      // id -> hash of the bytes of its entries
+        bool                                    m_incremental = false;
+        size_t                                  m_parsedEntries = 0;
+
+        double                                  m_parseSeconds = 0;
+        double                                  m_indexSeconds = 0;
+    };
+
+    /*
+     * .ltfb is a compiled form of an .ltf file that can be mapped and queried
+     * without any parsing. Create one with the ltfc tool (or CompileLtfb) and load
+     * it with LtfBinFile. Layout (all offsets are from the start of the file,
+     * little endian, every section is 8 byte aligned):
+     * 
+     *  - LtfbHeader
+     *  - entries:  LtfbEntry[entryCount], slots of the perfect hash table (tag -> entry),
+ *              there's some slack so not every slot holds a tag
+     *  - seeds:    uint32_t[seedCount], per-bucket displacement seeds of the perfect hash
+     *  - columns:  LtfbColumn[columnCount], one per language / variation
+     *  - tables:   LtfbText[entryCount] per column, text of every entry in that column,
+     *              offsets are into the text stream
+     *  - pool:     all tags and variation names
+     *  - text:     all texts (already unescaped), grouped by column. stored as is, or with
+     *              LTFB_COMPRESSED split into blocks of blockSize bytes that are compressed
+     *              on their own (see Lz.h): LtfbBlock[blockCount] at blocksOffset, then the data.
+     *              a lookup then only decodes the blocks its text lies in
+     */
+    namespace itrn
+    {
+        inline constexpr char     LTFB_MAGIC[4] = { 'L', 'T', 'F', 'B' };
+        inline constexpr uint32_t LTFB_VERSION = 3;
+        inline constexpr uint32_t LTFB_NO_TEXT = 0xFFFFFFFF;
+        inline constexpr uint32_t LTFB_BUCKET_SIZE = 4;      // average keys per perfect hash bucket
+        inline constexpr uint32_t LTFB_SLACK = 4;            // 1 / LTFB_SLACK of the slots are left free to speed up the build
+        inline constexpr uint32_t LTFB_COMPRESSED = 1;       // header flag
+        inline constexpr uint32_t LTFB_DEFAULT_BLOCK_SIZE = 16 * 1024;
+
+        struct LtfbHeader
+        {
+            char        magic[4];
+            uint32_t    version;
+            uint64_t    checksum;       // Fnv1a of everything after the header
+            uint64_t    fileSize;       // size of the whole .ltfb
+            uint64_t    sourceSize;     // size and write time of the .ltf it was compiled from,
+            int64_t     sourceTime;     // used to detect stale blobs
+            uint32_t    tagCount;
+            uint32_t    entryCount;     // number of perfect hash slots (>= tagCount)
+            uint32_t    seedCount;
+            uint32_t    columnCount;
+            uint32_t    entriesOffset;
+            uint32_t    seedsOffset;
+            uint32_t    columnsOffset;
+            uint32_t    tablesOffset;
+            uint32_t    poolOffset;
+            uint32_t    flags;
+            uint32_t    textOffset;     // raw text, or the first compressed block
+            uint32_t    textSize;       // size of the (decoded) text stream
+            uint32_t    blockSize;      // decoded size of every block but the last
+            uint32_t    blockCount;
+            uint32_t    blocksOffset;
+            uint32_t    poolSize;       // tags and variation names are checked against it on load
+        };
+
+        struct LtfbEntry  { uint32_t tagOffset, tagSize; };
+        struct LtfbText   { uint32_t offset, size; };      // offset is LTFB_NO_TEXT if there's no translation
+        struct LtfbColumn { uint32_t lan, varOffset, varSize, tableOffset; };
+        struct LtfbBlock  { uint32_t offset, size; };      // compressed data of a block, offset is from the start of the file
+
+        inline uint32_t LtfbBucket(uint64_t hash, uint32_t seedCount) { return static_cast<uint32_t>(hash % seedCount); }
+        inline uint32_t LtfbSlot(uint64_t hash, uint32_t seed, uint32_t entryCount) { return static_cast<uint32_t>(util::Mix64(hash + seed) % entryCount); }
+
+        // 0 if the file is gone (e.g. being replaced by a rename), an image built then is stale as soon as it's back
+        inline int64_t GetWriteTime(const std::filesystem::path& path)
+        {
+            std::error_code ec;
+            const auto time = std::filesystem::last_write_time(path, ec);
+            return ec ? 0 : time.time_since_epoch().count();
+        }
+
+        // builds a perfect hash over tags: slot = LtfbSlot(hash, seeds[LtfbBucket(hash)], slotCount)
+        // returns the slot for every tag in the same order
+        inline std::vector<uint32_t> BuildPerfectHash(const std::vector<std::string_view>& tags, uint32_t slotCount, std::vector<uint32_t>& seeds)
+        {
+            const uint32_t count = static_cast<uint32_t>(tags.size());
+            seeds.assign(std::max<uint32_t>(1, (count + LTFB_BUCKET_SIZE - 1) / LTFB_BUCKET_SIZE), 0);
+
+            std::vector<uint64_t> hashes(count);
+            std::vector<std::vector<uint32_t>> buckets(seeds.size());
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                hashes[i] = util::Fnv1a(tags[i]);
+                buckets[LtfbBucket(hashes[i], static_cast<uint32_t>(seeds.size()))].push_back(i);
+            }
+
+            // place the largest buckets first while there's still room
+            std::vector<uint32_t> order(buckets.size());
+            for (uint32_t b = 0; b < order.size(); ++b) order[b] = b;
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+            std::vector<uint32_t> slots(count);
+            std::vector<bool> taken(slotCount, false);
+            std::vector<uint32_t> trial;
+            for (uint32_t b : order)
+            {
+                if (buckets[b].empty()) break;
+
+                for (uint32_t seed = 1; ; ++seed)
+                {
+                    if (seed == 0) throw exc::CoreException("Failed to build a perfect hash for .ltfb (duplicate tags?)");
+
+                    trial.clear();
+                    bool fits = true;
+                    for (uint32_t key : buckets[b])
+                    {
+                        uint32_t slot = LtfbSlot(hashes[key], seed, slotCount);
+                        if (taken[slot] || std::find(trial.begin(), trial.end(), slot) != trial.end())
+                        {
+                            fits = false;
+                            break;
+                        }
+                        trial.push_back(slot);
+                    }
+                    if (!fits) continue;
+
+                    for (size_t k = 0; k < trial.size(); ++k)
+                    {
+                        taken[trial[k]] = true;
+                        slots[buckets[b][k]] = trial[k];
+                    }
+                    seeds[b] = seed;
+                    break;
+                }
+            }
+            return slots;
+        }
+    }
+
+    // checks an .ltf file for errors without loading it into memory (see LtfStreamReader),
+    // returns false (and logs the error) on failure
+    inline bool CheckLtf(const std::filesystem::path& path, size_t blockSize = itrn::LtfStreamReader::DEFAULT_BLOCK_SIZE)
+    {
+        try
+        {
+            itrn::LtfStreamReader reader(path, blockSize);
+            reader.Parse([](const itrn::LtfSlice&) {});
+        }
+        catch (const exc::IException& e)
+        {
+            lg::Error(e.What());
+            return false;
+        }
+        return true;
+    }
+
+    namespace itrn
+    {
+        // an .ltfb image of the .ltf file at srcPath (see CompileLtfb)
+        inline std::string BuildLtfb(const std::filesystem::path& srcPath, uint32_t blockSize)
+        {
+            File src;
+            src.Open(srcPath, FileMode::READ);
+            src.Map();
+
+            // gather everything first, the pool is written once the sizes are known
+            std::vector<std::string_view> tags;
+            std::unordered_map<std::string_view, uint32_t> tagIds;
+            std::vector<std::pair<Language, std::string_view>> columns;
+            std::vector<std::vector<std::pair<uint32_t, LtfbText>>> columnTexts;  // per column: (tag id, text in columnData)
+            std::vector<std::string> columnData;
+            std::string pool;
+
+            auto addToPool = [&pool](std::string_view str)
+                {
+                    LtfbText t{ static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(str.size()) };
+                    pool.append(str);
+                    return t;
+                };
+
+            LtfReader reader(src.GetView());
+            reader.Parse([&](const LtfSlice& slice)
+                {
+                    auto [it, added] = tagIds.try_emplace(slice.id, static_cast<uint32_t>(tags.size()));
+                    if (added) tags.push_back(slice.id);
+
+                    auto col = std::find(columns.begin(), columns.end(), std::pair{ slice.lan, slice.var });
+                    if (col == columns.end())
+                    {
+                        columns.emplace_back(slice.lan, slice.var);
+                        columnTexts.emplace_back();
+                        columnData.emplace_back();
+                        col = columns.end() - 1;
+                    }
+
+                    // text of a language is kept together, so a lookup in one language touches few blocks
+                    std::string& data = columnData[col - columns.begin()];
+                    columnTexts[col - columns.begin()].emplace_back(it->second, LtfbText{ static_cast<uint32_t>(data.size()), static_cast<uint32_t>(slice.text.size()) });
+                    data.append(slice.text);
+                });
+
+            const uint32_t slotCount = static_cast<uint32_t>(tags.size() + tags.size() / LTFB_SLACK);
+            std::vector<uint32_t> seeds;
+            std::vector<uint32_t> slots = BuildPerfectHash(tags, slotCount, seeds);
+
+            std::vector<LtfbEntry> entries(slotCount, LtfbEntry{ 0, 0 });
+            for (size_t i = 0; i < tags.size(); ++i)
+            {
+                LtfbText t = addToPool(tags[i]);
+                entries[slots[i]] = { t.offset, t.size };
+            }
+
+            std::vector<LtfbColumn> cols(columns.size());
+            std::vector<LtfbText> tables(columns.size() * slotCount, LtfbText{ LTFB_NO_TEXT, 0 });
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                LtfbText var = addToPool(columns[c].second);
+                cols[c] = { static_cast<uint32_t>(columns[c].first), var.offset, var.size, 0 };
+            }
+
+            std::string text;
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                for (auto [tag, t] : columnTexts[c])
+                    tables[c * slotCount + slots[tag]] = { static_cast<uint32_t>(text.size() + t.offset), t.size };
+                text.append(columnData[c]);
+                std::string().swap(columnData[c]);
+            }
+            if (text.size() > UINT32_MAX) throw exc::CoreException("Text is too large for .ltfb");
+
+            std::vector<LtfbBlock> blocks;
+            std::string compressed;
+            if (blockSize)
+            {
+                for (size_t offset = 0; offset < text.size(); offset += blockSize)
+                {
+                    const size_t begin = compressed.size();
+                    util::LzCompress(std::string_view(text).substr(offset, blockSize), compressed);
+                    blocks.push_back({ static_cast<uint32_t>(begin), static_cast<uint32_t>(compressed.size() - begin) });
+                }
+            }
+
+            // layout
+            auto align = [](size_t n) { return (n + 7) & ~size_t(7); };
+            LtfbHeader header{};
+            std::memcpy(header.magic, LTFB_MAGIC, sizeof(LTFB_MAGIC));
+            header.version = LTFB_VERSION;
+            header.sourceSize = src.GetSize();
+            header.sourceTime = GetWriteTime(srcPath);
+            header.tagCount = static_cast<uint32_t>(tags.size());
+            header.entryCount = slotCount;
+            header.seedCount = static_cast<uint32_t>(seeds.size());
+            header.columnCount = static_cast<uint32_t>(cols.size());
+            header.entriesOffset = static_cast<uint32_t>(align(sizeof(LtfbHeader)));
+            header.seedsOffset = static_cast<uint32_t>(align(header.entriesOffset + entries.size() * sizeof(LtfbEntry)));
+            header.columnsOffset = static_cast<uint32_t>(align(header.seedsOffset + seeds.size() * sizeof(uint32_t)));
+            header.tablesOffset = static_cast<uint32_t>(align(header.columnsOffset + cols.size() * sizeof(LtfbColumn)));
+            header.poolOffset = static_cast<uint32_t>(align(header.tablesOffset + tables.size() * sizeof(LtfbText)));
+            header.flags = blockSize ? LTFB_COMPRESSED : 0;
+            header.textSize = static_cast<uint32_t>(text.size());
+            header.blockSize = blockSize;
+            header.blockCount = static_cast<uint32_t>(blocks.size());
+            header.poolSize = static_cast<uint32_t>(pool.size());
+            header.blocksOffset = static_cast<uint32_t>(align(header.poolOffset + pool.size()));
+            header.textOffset = static_cast<uint32_t>(align(header.blocksOffset + blocks.size() * sizeof(LtfbBlock)));
+            header.fileSize = header.textOffset + (blockSize ? compressed.size() : text.size());
+            if (header.fileSize > UINT32_MAX) throw exc::CoreException("Too much text for .ltfb, offsets are 32 bit");
+
+            for (auto& block : blocks) block.offset += header.textOffset;
+
+            for (size_t c = 0; c < cols.size(); ++c)
+                cols[c].tableOffset = static_cast<uint32_t>(header.tablesOffset + c * slotCount * sizeof(LtfbText));
+
+            std::string blob(header.fileSize, '\0');
+            auto put = [&blob](size_t offset, const void* data, size_t size) { if (size) std::memcpy(blob.data() + offset, data, size); };
+            put(header.entriesOffset, entries.data(), entries.size() * sizeof(LtfbEntry));
+            put(header.seedsOffset, seeds.data(), seeds.size() * sizeof(uint32_t));
+            put(header.columnsOffset, cols.data(), cols.size() * sizeof(LtfbColumn));
+            put(header.tablesOffset, tables.data(), tables.size() * sizeof(LtfbText));
+            put(header.poolOffset, pool.data(), pool.size());
+            put(header.blocksOffset, blocks.data(), blocks.size() * sizeof(LtfbBlock));
+            if (blockSize) put(header.textOffset, compressed.data(), compressed.size());
+            else put(header.textOffset, text.data(), text.size());
+
+            header.checksum = util::Fnv1a(std::string_view(blob).substr(sizeof(LtfbHeader)));
+            put(0, &header, sizeof(LtfbHeader));
+            return blob;
+        }
+    }
+
+    // compiles an .ltf file into .ltfb, returns false (and logs the error) on failure.
+    // with a blockSize the text is compressed in blocks of that size (smaller blocks make
+    // lookups decode less, larger ones compress better)
+    inline bool CompileLtfb(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath, uint32_t blockSize = 0)
+    {
+        try
+        {
+            const std::string blob = itrn::BuildLtfb(srcPath, blockSize);
+            std::ofstream out(dstPath, std::ios::binary | std::ios::trunc);
+            if (!out.write(blob.data(), blob.size()))
+                throw exc::CoreException(std::format("Failed to write {}", dstPath.string()));
+        }
+        catch (const exc::IException& e)
+        {
+            lg::Error(std::format("{}\n          When trying to compile {}", e.What(), srcPath.string()));
+            return false;
+        }
+        return true;
+    }
+
+    // read-only access to a compiled .ltfb file, lookups work directly on the mapping.
+    // in a compressed file, the functions that return views decode all text on first use
+    // (the views have to stay valid), ReadText / ReadColumnText only decode the blocks
+    // they need and keep the latest ones in a small cache.
+    // PrepareShared loads the image of an .ltf from shared memory instead, so processes
+    // that load the same file build it once. PrepareCached does the same with a file
+    class LtfBinFile : public File
+    {
+    public:
+        static constexpr uint32_t NO_ENTRY = 0xFFFFFFFF;
+        static constexpr size_t DEFAULT_CACHE_BLOCKS = 16;
+
+        // opens, maps and validates the file (magic, version, size, layout and every tag and text reference).
+        // with verifyChecksum the whole file is also read and checked against the header checksum
+        bool Prepare(const std::filesystem::path& path, bool verifyChecksum = true)
+        {
+            const auto begin = itrn::StatsClock::now();
+            m_Reset();
+            try
+            {
+                if (!Open(path, FileMode::READ) || !Map()) return false;
+                m_blob = GetView();
+                m_Validate(verifyChecksum);
+            }
+            catch (const exc::IException& e)
+            {
+                lg::Error(std::format("{}\n          When trying to load {}", e.What(), path.string()));
+                return false;
+            }
+            m_ready = true;
+            m_prepareSeconds = itrn::SecondsSince(begin);
+            return true;
+        }
+
+        // loads the .ltfb image of the .ltf file at sourcePath from a shared memory segment named
+        // after the path (see GetSharedName). if there's none, or the .ltf changed since it was
+        // built, the image is built and published for other processes first. the process that
+        // published a segment removes it when it lets go of the image, others keep their mapping.
+        // false if shared memory isn't available or another process is publishing at the moment
+        bool PrepareShared(const std::filesystem::path& sourcePath)
+        {
+            const auto begin = itrn::StatsClock::now();
+            m_Reset();
+            const std::string name = GetSharedName(sourcePath);
+            try
+            {
+                switch (m_AttachShared(name, sourcePath))
+                {
+                case SharedState::ATTACHED:
+                    break;
+
+                case SharedState::PUBLISHING:
+                    m_Reset();
+                    return false;
+
+                case SharedState::STALE:
+                    m_shared.Unlink(name);      // unless it was replaced since we looked at it
+                    m_Reset();
+                    [[fallthrough]];
+
+                case SharedState::MISSING:
+                    // another process that got here first publishes it, we don't wait for that
+                    if (!SharedMemory::Create(name, itrn::BuildLtfb(sourcePath, 0))) return false;
+                    if (m_AttachShared(name, sourcePath) != SharedState::ATTACHED)
+                    {
+                        m_Reset();
+                        return false;
+                    }
+                    m_shared.UnlinkOnClose(name);
+                    break;
+                }
+            }
+            catch (const exc::IException& e)
+            {
+                lg::Error(std::format("{}\n          When trying to share {}", e.What(), sourcePath.string()));
+                m_Reset();
+                return false;
+            }
+            m_ready = true;
+            m_prepareSeconds = itrn::SecondsSince(begin);     // includes building the image if this process did
+            return true;
+        }
+
+        // maps the .ltfb image of the .ltf file at sourcePath from "dir", building it there first if there's
+        // none or the .ltf changed since. the text is then read from the mapping, so unlike a map of the .ltf
+        // it only takes memory while the OS keeps its pages in (and can drop them when it needs the memory)
+        bool PrepareCached(const std::filesystem::path& sourcePath, const std::filesystem::path& dir)
+        {
+            const auto begin = itrn::StatsClock::now();
+            m_Reset();
+            Close();
+            const std::filesystem::path path = dir / (GetSharedName(sourcePath).substr(1) + ".ltfb");
+            try
+            {
+                if (!m_OpenImage(path, sourcePath))
+                {
+                    // written under a name of its own and renamed, so no process maps a half written image
+                    const std::string blob = itrn::BuildLtfb(sourcePath, 0);
+                    const uint64_t unique = util::Mix64(reinterpret_cast<uintptr_t>(this) ^ static_cast<uint64_t>(begin.time_since_epoch().count()));
+                    const std::filesystem::path tmp = path.string() + std::format(".{:016x}.tmp", unique);
+
+                    std::filesystem::create_directories(dir);
+                    {
+                        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                        if (!out.write(blob.data(), blob.size())) throw exc::CoreException(std::format("Failed to write {}", tmp.string()));
+                    }
+                    std::filesystem::rename(tmp, path);
+                    if (!m_OpenImage(path, sourcePath)) throw exc::CoreException(std::format("Failed to map {}", path.string()));
+                }
+            }
+            catch (const exc::IException& e)
+            {
+                lg::Error(std::format("{}\n          When trying to cache {}", e.What(), sourcePath.string()));
+                m_Reset();
+                return false;
+            }
+            catch (const std::filesystem::filesystem_error& e)
+            {
+                lg::Error(std::format("{}\n          When trying to cache {}", e.what(), sourcePath.string()));
+                m_Reset();
+                return false;
+            }
+            m_ready = true;
+            m_prepareSeconds = itrn::SecondsSince(begin);
+            return true;
+        }
+
+        // name of the shared memory segment of an .ltf file
+        static std::string GetSharedName(const std::filesystem::path& sourcePath)
+        {
+            std::error_code ec;
+            std::filesystem::path abs = std::filesystem::absolute(sourcePath, ec);
+            return std::format("/space_ltfb_{:016x}", util::Fnv1a((ec ? sourcePath : abs).lexically_normal().string()));
+        }
+
+        bool IsShared() const { return m_shared.IsOpen(); }
+
+        // true if the .ltf the blob was compiled from has changed since
+        bool IsStale(const std::filesystem::path& sourcePath) const
+        {
+            return !m_ready || m_SourceChanged(sourcePath);
+        }
+
+        // entry of a tag, or NO_ENTRY
+        uint32_t FindEntry(std::string_view tag) const
+        {
+            if (!m_ready) return NO_ENTRY;     // there's no header to read yet
+
+            const auto& h = m_Header();
+            if (h.entryCount == 0) return NO_ENTRY;
+
+            uint64_t hash = util::Fnv1a(tag);
+            uint32_t seed = m_Array<uint32_t>(h.seedsOffset)[itrn::LtfbBucket(hash, h.seedCount)];
+            uint32_t slot = itrn::LtfbSlot(hash, seed, h.entryCount);
+
+            return GetTag(slot) == tag ? slot : NO_ENTRY;
+        }
+
+        // text of an entry in the given language (and variation), nullopt if there's no translation
+        std::optional<std::string_view> GetText(uint32_t entry, Language ln, std::string_view var = {}) const
+        {
+            const itrn::LtfbText* text = m_FindText(entry, ln, var);
+            if (!text) return std::nullopt;
+            return m_Text(*text);
+        }
+
+        // same as GetText, but copies the text out, so only its blocks are decoded in a compressed file
+        std::optional<String> ReadText(uint32_t entry, Language ln, std::string_view var = {}) const
+        {
+            const itrn::LtfbText* text = m_FindText(entry, ln, var);
+            if (!text) return std::nullopt;
+            return m_ReadText(*text);
+        }
+
+        std::optional<std::string_view> Find(std::string_view tag, Language ln, std::string_view var = {}) const
+        {
+            return GetText(FindEntry(tag), ln, var);
+        }
+
+        std::string_view GetTag(uint32_t entry) const
+        {
+            const auto& e = m_Array<itrn::LtfbEntry>(m_Header().entriesOffset)[entry];
+            return m_Pool(e.tagOffset, e.tagSize);
+        }
+
+        // entries are perfect hash slots, some of them are empty (GetTag returns an empty string)
+        uint32_t GetEntryCount() const { return m_ready ? m_Header().entryCount : 0; }
+        uint32_t GetTagCount() const { return m_ready ? m_Header().tagCount : 0; }
+
+        // columns are the language / variation pairs present in the file
+        uint32_t GetColumnCount() const { return m_ready ? m_Header().columnCount : 0; }
+
+        std::pair<Language, std::string_view> GetColumn(uint32_t column) const
+        {
+            const auto& col = m_Array<itrn::LtfbColumn>(m_Header().columnsOffset)[column];
+            return { static_cast<Language>(col.lan), m_Pool(col.varOffset, col.varSize) };
+        }
+
+        std::optional<std::string_view> GetColumnText(uint32_t entry, uint32_t column) const
+        {
+            const auto& col = m_Array<itrn::LtfbColumn>(m_Header().columnsOffset)[column];
+            const auto& text = m_Array<itrn::LtfbText>(col.tableOffset)[entry];
+            if (text.offset == itrn::LTFB_NO_TEXT) return std::nullopt;
+            return m_Text(text);
+        }
+
+        std::optional<String> ReadColumnText(uint32_t entry, uint32_t column) const
+        {
+            const auto& col = m_Array<itrn::LtfbColumn>(m_Header().columnsOffset)[column];
+            const auto& text = m_Array<itrn::LtfbText>(col.tableOffset)[entry];
+            if (text.offset == itrn::LTFB_NO_TEXT) return std::nullopt;
+            return m_ReadText(text);
+        }
+
+        bool IsCompressed() const { return m_ready && (m_Header().flags & itrn::LTFB_COMPRESSED); }
+
+        // how many decoded blocks ReadText keeps
+        void SetCacheSize(size_t blocks)
+        {
+            std::scoped_lock lock(m_mutex);
+            m_cache.SetCapacity(blocks);
+        }
+
+        // memory held by decoded text (the cache, and all text once a view was requested)
+        size_t GetDecodedBytes() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_cache.GetBytes() + (m_decoded ? m_Header().textSize : 0);
+        }
+
+        // the same numbers as LtfFile::GetStats, there's no map or index to speak of
+        LtfStats GetStats() const
+        {
+            LtfStats stats;
+            if (!m_ready) return stats;
+
+            stats.mappedBytes = m_blob.size();
+            stats.residentBytes = file::GetResidentBytes(m_blob);
+            stats.cacheBytes = GetDecodedBytes();
+            stats.entries = GetTagCount();
+            stats.parseSeconds = m_prepareSeconds;
+
+            const auto& h = m_Header();
+            const auto* cols = m_Array<itrn::LtfbColumn>(h.columnsOffset);
+            for (uint32_t c = 0; c < h.columnCount; ++c)
+            {
+                if (cols[c].lan >= LANGUAGE_COUNT) continue;
+                const auto* texts = m_Array<itrn::LtfbText>(cols[c].tableOffset);
+                stats.texts[cols[c].lan] += std::count_if(texts, texts + h.entryCount, [](const itrn::LtfbText& t) { return t.offset != itrn::LTFB_NO_TEXT; });
+            }
+            return stats;
+        }
+
+    private:
+        const itrn::LtfbHeader& m_Header() const { return *reinterpret_cast<const itrn::LtfbHeader*>(m_Data()); }
+        const char* m_Data() const { return m_blob.data(); }
+
+        void m_Reset()
+        {
+            m_ready = false;
+            m_blob = {};
+            m_shared.Close();
+            m_decoded.reset();
+            m_text.store(nullptr);
+            m_cache.Clear();
+        }
+
+        enum class SharedState { ATTACHED, MISSING, PUBLISHING, STALE };
+
+        // a segment whose writer hasn't stored the ready word after this long was abandoned
+        static constexpr int64_t SHARED_PUBLISH_TIMEOUT = 60;      // seconds
+
+        // the segment stays open unless it's ATTACHED or MISSING, so a STALE one can be unlinked
+        SharedState m_AttachShared(const std::string& name, const std::filesystem::path& sourcePath)
+        {
+            if (!m_shared.Open(name)) return SharedState::MISSING;
+
+            // the magic and version are the ready word, stored last (see SharedMemory::Create)
+            static_assert(offsetof(itrn::LtfbHeader, version) + sizeof(uint32_t) == SharedMemory::READY_SIZE);
+            const uint64_t ready = m_shared.LoadReadyWord();
+            if (ready == 0)
+            {
+                const bool abandoned = static_cast<int64_t>(std::time(nullptr)) - m_shared.GetCreateTime() > SHARED_PUBLISH_TIMEOUT;
+                return abandoned ? SharedState::STALE : SharedState::PUBLISHING;
+            }
+
+            m_blob = m_shared.GetView();
+            try
+            {
+                m_Validate(false);
+            }
+            catch (const exc::IException&)
+            {
+                m_blob = {};
+                return SharedState::STALE;      // written by an older version, or corrupted
+            }
+
+            if (m_SourceChanged(sourcePath))
+            {
+                m_blob = {};
+                return SharedState::STALE;
+            }
+            return SharedState::ATTACHED;
+        }
+
+        // false if the image file is missing, corrupted or stale
+        bool m_OpenImage(const std::filesystem::path& path, const std::filesystem::path& sourcePath)
+        {
+            std::error_code ec;
+            if (!std::filesystem::exists(path, ec)) return false;
+            try
+            {
+                if (!Open(path, FileMode::READ) || !Map()) throw exc::CoreException(std::format("Failed to map {}", path.string()));
+                m_blob = GetView();
+                m_Validate(false);
+                if (!m_SourceChanged(sourcePath)) return true;
+            }
+            catch (const exc::IException&)
+            {
+                // written by an older version, replaced like a stale one
+            }
+            m_Reset();
+            Close();
+            return false;
+        }
+
+        bool m_SourceChanged(const std::filesystem::path& sourcePath) const
+        {
+            std::error_code ec;
+            if (!std::filesystem::exists(sourcePath, ec)) return true;
+            return std::filesystem::file_size(sourcePath, ec) != m_Header().sourceSize
+                || itrn::GetWriteTime(sourcePath) != m_Header().sourceTime;
+        }
+
+        template<typename T>
+        const T* m_Array(uint32_t offset) const { return reinterpret_cast<const T*>(m_Data() + offset); }
+
+        std::string_view m_Pool(uint32_t offset, uint32_t size) const
+        {
+            return std::string_view(m_Data() + m_Header().poolOffset + offset, size);
+        }
+
+        const itrn::LtfbText* m_FindText(uint32_t entry, Language ln, std::string_view var) const
+        {
+            if (!m_ready || entry == NO_ENTRY) return nullptr;
+
+            const auto& h = m_Header();
+            const auto* cols = m_Array<itrn::LtfbColumn>(h.columnsOffset);
+            for (uint32_t c = 0; c < h.columnCount; ++c)
+            {
+                if (cols[c].lan != static_cast<uint32_t>(ln) || m_Pool(cols[c].varOffset, cols[c].varSize) != var) continue;
+
+                const auto& text = m_Array<itrn::LtfbText>(cols[c].tableOffset)[entry];
+                return text.offset == itrn::LTFB_NO_TEXT ? nullptr : &text;
+            }
+            return nullptr;
+        }
+
+        std::string_view m_Text(const itrn::LtfbText& text) const
+        {
+            const char* data = m_text.load(std::memory_order_acquire);
+            if (!data) data = m_DecodeAll();
+            return std::string_view(data + text.offset, text.size);
+        }
+
+        // the text stream, decoded once for files that are compressed
+        const char* m_DecodeAll() const
+        {
+            std::scoped_lock lock(m_mutex);
+            if (const char* data = m_text.load()) return data;
+
+            const auto& h = m_Header();
+            auto decoded = std::make_unique_for_overwrite<char[]>(h.textSize);
+            for (uint32_t b = 0; b < h.blockCount; ++b) m_DecodeBlock(b, decoded.get() + size_t(b) * h.blockSize);
+            m_decoded = std::move(decoded);
+            m_text.store(m_decoded.get(), std::memory_order_release);
+            return m_decoded.get();
+        }
+
+        uint32_t m_BlockSize(uint32_t block) const
+        {
+            const auto& h = m_Header();
+            return static_cast<uint32_t>(std::min<uint64_t>(h.blockSize, h.textSize - uint64_t(block) * h.blockSize));
+        }
+
+        void m_DecodeBlock(uint32_t block, char* dst) const
+        {
+            const auto& b = m_Array<itrn::LtfbBlock>(m_Header().blocksOffset)[block];
+            util::LzDecompress(std::string_view(m_Data() + b.offset, b.size), dst, m_BlockSize(block));
+        }
+
+        String m_ReadText(const itrn::LtfbText& text) const
+        {
+            const auto& h = m_Header();
+            if (!(h.flags & itrn::LTFB_COMPRESSED) || m_text.load(std::memory_order_acquire)) return String(m_Text(text));
+            if (uint64_t(text.offset) + text.size > h.textSize) throw exc::CoreException(".ltfb text is out of range");
+
+            String out;
+            out.reserve(text.size);
+            std::scoped_lock lock(m_mutex);
+            for (size_t pos = text.offset, end = pos + text.size; pos < end;)
+            {
+                const uint32_t block = static_cast<uint32_t>(pos / h.blockSize);
+                const size_t begin = pos - size_t(block) * h.blockSize;
+                const size_t count = std::min<size_t>(end - pos, h.blockSize - begin);
+                const char* data = m_cache.Get(block, m_BlockSize(block), [&](char* dst) { m_DecodeBlock(block, dst); });
+                out.append(data + begin, count);
+                pos += count;
+            }
+            return out;
+        }
+
+        void m_Validate(bool verifyChecksum) const
+        {
+            using namespace itrn;
+
+            const size_t size = m_blob.size();
+            if (size < sizeof(LtfbHeader) || std::memcmp(m_Data(), LTFB_MAGIC, sizeof(LTFB_MAGIC)) != 0)
+                throw exc::CoreException("Not an .ltfb file");
+
+            const auto& h = m_Header();
+            if (h.version != LTFB_VERSION)
+                throw exc::CoreException(std::format(".ltfb version mismatch (file: {}, expected: {}), recompile it", h.version, LTFB_VERSION));
+            if (h.fileSize != size)
+                throw exc::CoreException(".ltfb file size doesn't match its header, the file is truncated or corrupted");
+
+            auto fits = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+            if (!fits(h.entriesOffset, uint64_t(h.entryCount) * sizeof(LtfbEntry))
+                || !fits(h.seedsOffset, uint64_t(h.seedCount) * sizeof(uint32_t))
+                || !fits(h.columnsOffset, uint64_t(h.columnCount) * sizeof(LtfbColumn))
+                || !fits(h.tablesOffset, uint64_t(h.columnCount) * h.entryCount * sizeof(LtfbText))
+                || !fits(h.poolOffset, h.poolSize)
+                || h.tagCount > h.entryCount
+                || (h.entryCount != 0 && h.seedCount == 0))
+                throw exc::CoreException(".ltfb layout is corrupted");
+
+            // every view handed out later is made from these without further checks
+            auto inPool = [&h](uint32_t offset, uint32_t bytes) { return offset <= h.poolSize && bytes <= h.poolSize - offset; };
+            const auto* entries = m_Array<LtfbEntry>(h.entriesOffset);
+            for (uint32_t e = 0; e < h.entryCount; ++e)
+            {
+                if (!inPool(entries[e].tagOffset, entries[e].tagSize))
+                    throw exc::CoreException(".ltfb tag is out of range");
+            }
+
+            const auto* cols = m_Array<LtfbColumn>(h.columnsOffset);
+            for (uint32_t c = 0; c < h.columnCount; ++c)
+            {
+                if (!fits(cols[c].tableOffset, uint64_t(h.entryCount) * sizeof(LtfbText)) || !inPool(cols[c].varOffset, cols[c].varSize))
+                    throw exc::CoreException(".ltfb layout is corrupted");
+
+                const auto* texts = m_Array<LtfbText>(cols[c].tableOffset);
+                for (uint32_t e = 0; e < h.entryCount; ++e)
+                {
+                    if (texts[e].offset != LTFB_NO_TEXT && (texts[e].offset > h.textSize || texts[e].size > h.textSize - texts[e].offset))
+                        throw exc::CoreException(".ltfb text is out of range");
+                }
+            }
+
+            if (!(h.flags & LTFB_COMPRESSED))
+            {
+                if (!fits(h.textOffset, h.textSize)) throw exc::CoreException(".ltfb layout is corrupted");
+                m_text.store(m_Data() + h.textOffset);
+            }
+            else
+            {
+                if (h.blockSize == 0 || h.blockCount != (uint64_t(h.textSize) + h.blockSize - 1) / h.blockSize
+                    || !fits(h.blocksOffset, uint64_t(h.blockCount) * sizeof(LtfbBlock)))
+                    throw exc::CoreException(".ltfb layout is corrupted");
+
+                const auto* blocks = m_Array<LtfbBlock>(h.blocksOffset);
+                for (uint32_t b = 0; b < h.blockCount; ++b)
+                {
+                    if (!fits(blocks[b].offset, blocks[b].size))
+                        throw exc::CoreException(".ltfb layout is corrupted");
+                }
+            }
+
+            if (verifyChecksum && util::Fnv1a(m_blob.substr(sizeof(LtfbHeader))) != h.checksum)
+                throw exc::CoreException(".ltfb checksum mismatch");
+        }
+
+    private:
+        bool                m_ready = false;
+        std::string_view    m_blob;         // the mapped file or shared memory segment
+        double              m_prepareSeconds = 0;
+        SharedMemory        m_shared;
+
+        // decoded text of a compressed file
+        mutable std::mutex                  m_mutex;
+        mutable util::LzBlockCache          m_cache{ DEFAULT_CACHE_BLOCKS };
+        mutable std::unique_ptr<char[]>     m_decoded;
+        mutable std::atomic<const char*>    m_text = nullptr;   // start of the text stream, once it's available
     };
-    
 }
\ No newline at end of file
@@ -0,0 +1,282 @@
+#pragma once
+
+// LZ77 block codec (in the spirit of LZ4): byte aligned, no entropy coding, so decoding is
+// a loop of copies and runs at memory speed. blocks are compressed on their own, so any one
+// of them can be decoded without the others.
+// a block is a list of sequences: token (literal count << 4 | match length - MIN_MATCH),
+// more literal count bytes if the count is 15 (255 means another byte follows), the literals,
+// then, except for the last sequence, a 2 byte little endian offset back into the output
+// and more match length bytes if the length field is 15
+
+#include "Exception.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <format>
+
+// API ---------------------------------
+
+namespace util
+{
+    // largest possible compressed size of "size" bytes
+    inline size_t LzCompressBound(size_t size);
+
+    // compresses src and appends it to out, returns the compressed size
+    inline size_t LzCompress(std::string_view src, std::string& out);
+
+    // decodes a block made by LzCompress into dst, "size" has to be the size it was compressed from.
+    // throws exc::CoreException if the block is corrupted (never writes past dst + size)
+    inline void LzDecompress(std::string_view src, char* dst, size_t size);
+
+    // decoded blocks, the least recently used one is dropped when a block is added to a full cache.
+    // not thread safe
+    class LzBlockCache
+    {
+    public:
+        explicit LzBlockCache(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1)) {}
+
+        // decoded block "index", "decode(char* dst)" is called to decode it into a buffer of "size" bytes
+        // if it isn't cached. the pointer is valid until the next call
+        template<typename Decode>
+        const char* Get(uint32_t index, size_t size, Decode&& decode);
+
+        void    SetCapacity(size_t capacity);   // in blocks
+        size_t  GetCapacity() const { return m_capacity; }
+        void    Clear() { m_blocks.clear(); }
+
+        size_t  GetHits() const     { return m_hits; }
+        size_t  GetMisses() const   { return m_misses; }
+        size_t  GetBytes() const;   // held by decoded blocks
+
+    private:
+        struct Block
+        {
+            uint32_t                    index = 0;
+            uint64_t                    lastUse = 0;
+            size_t                      size = 0;
+            std::unique_ptr<char[]>     data;
+        };
+
+        std::vector<Block>  m_blocks;       // few enough to be searched linearly
+        size_t              m_capacity;
+        uint64_t            m_clock = 0;
+        size_t              m_hits = 0;
+        size_t              m_misses = 0;
+    };
+}
+
+// -------------------------------------
+
+namespace util
+{
+    namespace itrn
+    {
+        inline constexpr size_t LZ_MIN_MATCH = 4;
+        inline constexpr size_t LZ_MAX_OFFSET = 0xFFFF;
+        inline constexpr size_t LZ_HASH_BITS = 14;
+
+        inline uint32_t LzRead32(const char* p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t LzHash(uint32_t v)
+        {
+            return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+        }
+
+        inline void LzPutLength(std::string& out, size_t length)
+        {
+            for (; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+            out.push_back(static_cast<char>(length));
+        }
+
+        inline void LzPutSequence(std::string& out, const char* literals, size_t literalCount, size_t offset, size_t matchLength)
+        {
+            const size_t matchField = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+            out.push_back(static_cast<char>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchField, 15)));
+            if (literalCount >= 15) LzPutLength(out, literalCount - 15);
+            out.append(literals, literalCount);
+            if (!matchLength) return;
+
+            out.push_back(static_cast<char>(offset & 0xFF));
+            out.push_back(static_cast<char>(offset >> 8));
+            if (matchField >= 15) LzPutLength(out, matchField - 15);
+        }
+
+        [[noreturn]] inline void LzCorrupted()
+        {
+            throw exc::CoreException("Compressed block is corrupted");
+        }
+
+        // reads an extended length, "p" is moved past it
+        inline size_t LzGetLength(const unsigned char*& p, const unsigned char* end)
+        {
+            size_t length = 0;
+            for (;;)
+            {
+                if (p == end) LzCorrupted();
+                const unsigned char b = *p++;
+                length += b;
+                if (b != 255) return length;
+            }
+        }
+    }
+
+    inline size_t LzCompressBound(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    inline size_t LzCompress(std::string_view src, std::string& out)
+    {
+        using namespace itrn;
+
+        const size_t start = out.size();
+        out.reserve(start + LzCompressBound(src.size()));
+
+        const char* base = src.data();
+        const size_t size = src.size();
+        std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);     // last position + 1 of a 4 byte sequence
+
+        size_t literal = 0;     // start of the pending literals
+        size_t i = 0;
+        size_t misses = 0;      // the longer nothing matches, the faster we skip ahead (incompressible data)
+        while (size >= LZ_MIN_MATCH && i + LZ_MIN_MATCH <= size)
+        {
+            const uint32_t seq = LzRead32(base + i);
+            uint32_t& slot = table[LzHash(seq)];
+            const size_t candidate = slot;
+            slot = static_cast<uint32_t>(i + 1);
+
+            if (candidate == 0 || i - (candidate - 1) > LZ_MAX_OFFSET || LzRead32(base + candidate - 1) != seq)
+            {
+                i += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // extend the match forwards, and backwards over pending literals
+            size_t match = candidate - 1;
+            size_t length = LZ_MIN_MATCH;
+            while (i + length < size && base[match + length] == base[i + length]) ++length;
+            while (i > literal && match > 0 && base[i - 1] == base[match - 1]) { --i; --match; ++length; }
+
+            LzPutSequence(out, base + literal, i - literal, i - match, length);
+            i += length;
+            literal = i;
+
+            // positions inside the match are added sparsely, that's enough for text
+            if (i >= 2 && i + 2 <= size && i - 2 + LZ_MIN_MATCH <= size)
+                table[LzHash(LzRead32(base + i - 2))] = static_cast<uint32_t>(i - 2 + 1);
+        }
+
+        LzPutSequence(out, base + literal, size - literal, 0, 0);
+        return out.size() - start;
+    }
+
+    inline void LzDecompress(std::string_view src, char* dst, size_t size)
+    {
+        using namespace itrn;
+
+        const auto* p = reinterpret_cast<const unsigned char*>(src.data());
+        const auto* end = p + src.size();
+        size_t out = 0;
+        while (p < end)
+        {
+            const unsigned char token = *p++;
+
+            size_t literals = token >> 4;
+            if (literals == 15) literals += LzGetLength(p, end);
+            if (literals > static_cast<size_t>(end - p) || literals > size - out) LzCorrupted();
+            if (literals <= 16 && end - p >= 16 && size - out >= 16) std::memcpy(dst + out, p, 16);    // short runs are the common case, a fixed size copy is cheaper
+            else std::memcpy(dst + out, p, literals);
+            p += literals;
+            out += literals;
+
+            if (p == end) break;    // the last sequence has no match
+
+            if (end - p < 2) LzCorrupted();
+            const size_t offset = p[0] | (size_t(p[1]) << 8);
+            p += 2;
+
+            size_t length = token & 15;
+            if (length == 15) length += LzGetLength(p, end);
+            length += LZ_MIN_MATCH;
+            if (offset == 0 || offset > out || length > size - out) LzCorrupted();
+
+            // overlapping matches repeat the bytes just written, so they're copied in steps of "offset"
+            char* to = dst + out;
+            const char* from = to - offset;
+            if (offset >= 8 && size - out >= length + 8)
+            {
+                // may write up to 7 bytes past the match, they're overwritten by what follows
+                for (size_t k = 0; k < length; k += 8) std::memcpy(to + k, from + k, 8);
+            }
+            else if (offset >= length) std::memcpy(to, from, length);
+            else for (size_t k = 0; k < length; ++k) to[k] = from[k];
+            out += length;
+        }
+        if (out != size) LzCorrupted();
+    }
+
+    template<typename Decode>
+    inline const char* LzBlockCache::Get(uint32_t index, size_t size, Decode&& decode)
+    {
+        ++m_clock;
+        for (auto& block : m_blocks)
+        {
+            if (block.index != index) continue;
+            block.lastUse = m_clock;
+            ++m_hits;
+            return block.data.get();
+        }
+
+        ++m_misses;
+        Block* block = nullptr;
+        if (m_blocks.size() < m_capacity) block = &m_blocks.emplace_back();
+        else block = &*std::min_element(m_blocks.begin(), m_blocks.end(),
+            [](const Block& a, const Block& b) { return a.lastUse < b.lastUse; });
+
+        if (!block->data || block->size < size) block->data = std::make_unique_for_overwrite<char[]>(size);
+        block->size = size;
+        block->index = index;
+        block->lastUse = m_clock;
+        try
+        {
+            decode(block->data.get());
+        }
+        catch (...)
+        {
+            block->lastUse = 0;
+            block->index = UINT32_MAX;     // never matches a real block
+            throw;
+        }
+        return block->data.get();
+    }
+
+    inline void LzBlockCache::SetCapacity(size_t capacity)
+    {
+        m_capacity = std::max<size_t>(capacity, 1);
+        if (m_blocks.size() <= m_capacity) return;
+
+        // keep the most recently used ones
+        std::sort(m_blocks.begin(), m_blocks.end(), [](const Block& a, const Block& b) { return a.lastUse > b.lastUse; });
+        m_blocks.resize(m_capacity);
+    }
+
+    inline size_t LzBlockCache::GetBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& block : m_blocks) bytes += block.size;
+        return bytes;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// helpers for spreading work over a bounded number of threads
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace util
+{
+    // number of threads to use when the caller doesn't care (0 means "as many as there are cores")
+    inline size_t GetThreadCount(size_t requested = 0)
+    {
+        if (requested != 0) return requested;
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    // calls fn(i) for every i in [0, count), using up to maxThreads threads (including the calling one)
+    // items are handed out one at a time, so uneven items balance out. fn must not throw
+    template<typename Fn>
+    inline void ParallelFor(size_t count, size_t maxThreads, Fn&& fn)
+    {
+        const size_t threads = std::min(count, GetThreadCount(maxThreads));
+        if (threads <= 1)
+        {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        std::atomic<size_t> next = 0;
+        auto work = [&]()
+            {
+                for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+                    fn(i);
+            };
+
+        std::vector<std::jthread> workers;
+        workers.reserve(threads - 1);
+        for (size_t t = 1; t < threads; ++t) workers.emplace_back(work);
+        work();
+    }
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+// read-copy-update: readers see an immutable version of an object without locks or
+// reference counts, writers publish a new version and free the old one once no reader can
+// still use it. every thread has its own slot where it notes the epoch its read section
+// started in, so entering one is a few loads and a store to memory no other reader writes to.
+// readers never wait, writers wait for readers that started before their version was
+// published. writers have to be serialized by the caller
+
+#include "Exception.h"
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <format>
+
+// API ---------------------------------
+
+namespace util
+{
+    // threads that can read at the same time, slots of finished threads are reused
+    inline constexpr size_t RCU_MAX_THREADS = 256;
+
+    template<typename T>
+    class Rcu
+    {
+    public:
+        // keeps the version it was created with alive. writers wait for it, so it's meant to be
+        // short lived. belongs to the thread that created it, so it can't be moved
+        class ReadGuard
+        {
+        public:
+            explicit ReadGuard(const Rcu& rcu);
+            ~ReadGuard();
+
+            ReadGuard(const ReadGuard&) = delete;
+            ReadGuard& operator=(const ReadGuard&) = delete;
+
+            const T* Get() const            { return m_ptr; }
+            const T& operator*() const      { return *m_ptr; }
+            const T* operator->() const     { return m_ptr; }
+
+        private:
+            const Rcu&  m_rcu;
+            size_t      m_slot;
+            const T*    m_ptr;
+        };
+
+    public:
+        explicit Rcu(std::unique_ptr<const T> initial = nullptr);
+        ~Rcu();     // no thread may still be reading
+
+        Rcu(const Rcu&) = delete;
+        Rcu& operator=(const Rcu&) = delete;
+
+        ReadGuard Read() const { return ReadGuard(*this); }
+
+        // replaces the current version and waits until the old one is no longer read, then frees it.
+        // if the calling thread is reading itself, the old version is left for a later Publish or Reclaim
+        void Publish(std::unique_ptr<const T> next);
+
+        // frees replaced versions that are no longer read, returns how many are left
+        size_t Reclaim();
+
+        size_t GetRetiredCount() const { return m_retired.size(); }
+
+    private:
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t>   epoch = 0;      // when the thread's read section started, 0 if it's not reading
+            uint32_t                depth = 0;      // nested read sections, only used by the owning thread
+        };
+
+        struct Retired
+        {
+            std::unique_ptr<const T>    ptr;
+            uint64_t                    epoch;      // readers that started at this epoch or later can't see it
+        };
+
+    private:
+        std::atomic<const T*>                               m_current = nullptr;
+        std::atomic<uint64_t>                               m_epoch = 1;
+        mutable std::array<Slot, RCU_MAX_THREADS>           m_slots;
+        std::vector<Retired>                                m_retired;
+    };
+}
+
+// -------------------------------------
+
+namespace util
+{
+    namespace itrn
+    {
+        inline std::mutex rcuSlotMutex;
+        inline std::array<bool, RCU_MAX_THREADS> rcuSlotUsed{};
+
+        struct RcuThreadSlot
+        {
+            size_t index = 0;
+
+            RcuThreadSlot()
+            {
+                std::scoped_lock lock(rcuSlotMutex);
+                while (index < RCU_MAX_THREADS && rcuSlotUsed[index]) ++index;
+                if (index == RCU_MAX_THREADS)
+                    throw exc::CoreException(std::format("More than {} threads are reading through Rcu", RCU_MAX_THREADS));
+                rcuSlotUsed[index] = true;
+            }
+
+            ~RcuThreadSlot()
+            {
+                std::scoped_lock lock(rcuSlotMutex);
+                rcuSlotUsed[index] = false;
+            }
+        };
+
+        // the slot of the calling thread, the same one in every Rcu
+        inline size_t GetRcuThreadSlot()
+        {
+            thread_local RcuThreadSlot slot;
+            return slot.index;
+        }
+    }
+
+    template<typename T>
+    inline Rcu<T>::ReadGuard::ReadGuard(const Rcu& rcu)
+        : m_rcu(rcu), m_slot(itrn::GetRcuThreadSlot())
+    {
+        // the pointer is loaded after the epoch is noted, so a writer that doesn't see the
+        // note yet has already replaced the version we're going to get
+        Slot& slot = m_rcu.m_slots[m_slot];
+        if (slot.depth++ == 0) slot.epoch.store(m_rcu.m_epoch.load());
+        m_ptr = m_rcu.m_current.load();
+    }
+
+    template<typename T>
+    inline Rcu<T>::ReadGuard::~ReadGuard()
+    {
+        Slot& slot = m_rcu.m_slots[m_slot];
+        if (--slot.depth == 0) slot.epoch.store(0, std::memory_order_release);
+    }
+
+    template<typename T>
+    inline Rcu<T>::Rcu(std::unique_ptr<const T> initial)
+        : m_current(initial.release())
+    {
+    }
+
+    template<typename T>
+    inline Rcu<T>::~Rcu()
+    {
+        delete m_current.load();
+    }
+
+    template<typename T>
+    inline void Rcu<T>::Publish(std::unique_ptr<const T> next)
+    {
+        const T* old = m_current.exchange(next.release());
+        const uint64_t epoch = m_epoch.fetch_add(1) + 1;
+        if (old) m_retired.push_back({ std::unique_ptr<const T>(old), epoch });
+
+        // a thread waiting for its own read section would wait forever
+        if (m_slots[itrn::GetRcuThreadSlot()].depth > 0)
+        {
+            Reclaim();
+            return;
+        }
+        while (Reclaim() > 0) std::this_thread::yield();
+    }
+
+    template<typename T>
+    inline size_t Rcu<T>::Reclaim()
+    {
+        uint64_t oldest = UINT64_MAX;
+        for (const Slot& slot : m_slots)
+        {
+            uint64_t epoch = slot.epoch.load();
+            if (epoch != 0 && epoch < oldest) oldest = epoch;
+        }
+
+        std::erase_if(m_retired, [&](const Retired& retired) { return retired.epoch <= oldest; });
+        return m_retired.size();
+    }
+}
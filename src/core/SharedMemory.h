@@ -0,0 +1,190 @@
+#pragma once
+
+// named shared memory segments that other processes can map read-only.
+// a segment is written once by Create and never changed after that. a name is only taken by one
+// writer at a time (Create fails while it exists), replacing a stale segment means unlinking it first,
+// processes that still have it mapped keep it until they let go of it.
+// the first 8 bytes of the data (the ready word) are stored last with release semantics,
+// a reader that loads them with LoadReadyWord and sees them set sees everything.
+// only posix shm is supported, elsewhere Create and Open fail
+
+#include "Defines.h"
+#include "Exception.h"
+
+#if !WINDOWS_PLATFORM
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cstring>
+#endif
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+#include <format>
+
+// API ---------------------------------
+
+namespace file
+{
+    class SharedMemory
+    {
+    public:
+        SharedMemory() = default;
+        ~SharedMemory() { Close(); }
+
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+
+        static constexpr size_t READY_SIZE = sizeof(uint64_t);
+
+        // maps an existing segment read-only, false if there's none (or shm isn't available)
+        bool Open(const std::string& name);
+
+        // publishes "data" (at least READY_SIZE bytes) under "name". false if the name is taken:
+        // another process is publishing it, or a stale segment has to be unlinked first
+        static bool Create(const std::string& name, std::string_view data);
+
+        // removes "name" if it still refers to the segment this object has open,
+        // so a segment another process published in the meantime isn't touched
+        void        Unlink(const std::string& name) const;
+        static void Remove(const std::string& name);
+
+        // the segment is unlinked (as by Unlink) when it's closed, for the process that published it
+        void        UnlinkOnClose(const std::string& name) { m_unlinkName = name; }
+        void        Close();
+
+        std::string_view    GetView() const { return { m_data, m_size }; }
+        bool                IsOpen() const  { return m_data != nullptr; }
+        uint64_t            LoadReadyWord() const;      // 0 while the segment is being written
+        int64_t             GetCreateTime() const { return m_createTime; }     // seconds since the epoch
+
+    private:
+        const char* m_data = nullptr;
+        size_t      m_size = 0;
+        uint64_t    m_device = 0;       // identify the segment, the name may be reused
+        uint64_t    m_inode = 0;
+        int64_t     m_createTime = 0;
+        std::string m_unlinkName;
+    };
+}
+
+// -------------------------------------
+
+namespace file
+{
+#if !WINDOWS_PLATFORM
+
+    inline bool SharedMemory::Open(const std::string& name)
+    {
+        Close();
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);      // the mapping keeps the segment alive
+        if (map == MAP_FAILED) return false;
+
+        m_data = static_cast<const char*>(map);
+        m_size = static_cast<size_t>(st.st_size);
+        m_device = static_cast<uint64_t>(st.st_dev);
+        m_inode = static_cast<uint64_t>(st.st_ino);
+        m_createTime = static_cast<int64_t>(st.st_ctime);
+        return true;
+    }
+
+    inline bool SharedMemory::Create(const std::string& name, std::string_view data)
+    {
+        if (data.size() < READY_SIZE) throw exc::CoreException(std::format("Shared memory {} is smaller than its ready word", name));
+
+        // an existing segment is never replaced here, readers that have it mapped keep working
+        // and a writer that's still filling it isn't disturbed
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            if (errno == EEXIST) return false;
+            throw exc::CoreException(std::format("Failed to create shared memory {}: {}", name, std::strerror(errno)));
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(data.size())) == -1)
+        {
+            const int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw exc::CoreException(std::format("Failed to size shared memory {}: {}", name, std::strerror(error)));
+        }
+
+        void* map = mmap(nullptr, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw exc::CoreException(std::format("Failed to map shared memory {}: {}", name, std::strerror(errno)));
+        }
+
+        // ftruncate zero fills, so the ready word reads 0 until it's stored (the mapping is page aligned)
+        char* dst = static_cast<char*>(map);
+        std::memcpy(dst + READY_SIZE, data.data() + READY_SIZE, data.size() - READY_SIZE);
+        uint64_t ready;
+        std::memcpy(&ready, data.data(), READY_SIZE);
+        std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(dst)).store(ready, std::memory_order_release);
+        munmap(map, data.size());
+        return true;
+    }
+
+    inline void SharedMemory::Unlink(const std::string& name) const
+    {
+        if (!m_data) return;
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) return;
+        struct stat st;
+        const bool same = fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_dev) == m_device && static_cast<uint64_t>(st.st_ino) == m_inode;
+        close(fd);
+        if (same) shm_unlink(name.c_str());
+    }
+
+    inline void SharedMemory::Remove(const std::string& name)
+    {
+        shm_unlink(name.c_str());
+    }
+
+    inline uint64_t SharedMemory::LoadReadyWord() const
+    {
+        if (m_size < READY_SIZE) return 0;
+        // the mapping is read-only, an aligned atomic load doesn't write to it
+        return std::atomic_ref<uint64_t>(*const_cast<uint64_t*>(reinterpret_cast<const uint64_t*>(m_data))).load(std::memory_order_acquire);
+    }
+
+    inline void SharedMemory::Close()
+    {
+        if (!m_unlinkName.empty()) Unlink(m_unlinkName);
+        if (m_data) munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_unlinkName.clear();
+    }
+
+#else
+
+    inline bool SharedMemory::Open(const std::string&) { return false; }
+    inline bool SharedMemory::Create(const std::string&, std::string_view) { return false; }
+    inline void SharedMemory::Unlink(const std::string&) const {}
+    inline void SharedMemory::Remove(const std::string&) {}
+    inline uint64_t SharedMemory::LoadReadyWord() const { return 0; }
+    inline void SharedMemory::Close() {}
+
+#endif
+}
@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <array>
 #include <optional>
+#include <string_view>
+#include <cstdint>
 
 namespace util
 {
@@ -43,4 +45,26 @@ namespace util
         
         return TrimRight(TrimLeft(str));
     }
-}
\ No newline at end of file
+
+    // 64-bit FNV-1a, usable at compile time
+    constexpr uint64_t Fnv1a(std::string_view str, uint64_t hash = 0xcbf29ce484222325ull)
+    {
+        for (char c : str)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // splitmix64 finalizer, spreads bits of an already computed hash (e.g. for seeding)
+    constexpr uint64_t Mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+}
@@ -4,53 +4,240 @@ namespace eng
 {
     namespace loc
     {
-        Language Localization::m_gameLang;
+        std::atomic<Language> Localization::m_gameLang;
+
+        Localization::Localization()
+            : m_tables(m_BuildTables({}))
+        {
+        }
+
+        Localization::~Localization()
+        {
+            // loaders use the members, they're stopped (files that haven't started are skipped) and joined first
+            std::vector<std::jthread> loaders;
+            {
+                std::scoped_lock lock(m_writeMutex);
+                loaders = std::move(m_loaders);
+            }
+            loaders.clear();
+        }
 
         void Localization::LoadFiles(std::initializer_list<std::filesystem::path> paths)
         {
-            for (const auto& path : paths)
+            LoadFiles(std::span<const std::filesystem::path>(paths.begin(), paths.size()));
+        }
+
+        void Localization::LoadFiles(std::span<const std::filesystem::path> paths)
+        {
+            using Clock = std::chrono::steady_clock;
+            const auto begin = Clock::now();
+
+            std::scoped_lock lock(m_writeMutex);
+
+            // slots are created here, so the workers only touch their own LocFile and don't need a lock
+            std::vector<LocFile*> slots(paths.size(), nullptr);
+            for (size_t i = 0; i < paths.size(); ++i)
             {
                 try
                 {
-                    if (m_loadedLocFiles.contains(path.filename().string()))
-                    {
+                    if (m_loadedLocFiles.contains(paths[i].filename().string())
+                        || std::find(m_pendingNames.begin(), m_pendingNames.end(), paths[i].filename().string()) != m_pendingNames.end())
                         throw exc::EngineException("Localization file with this name is already loaded");
+
+                    auto& slot = m_loadedLocFiles[paths[i].filename().string()];
+                    slot = std::make_shared<LocFile>();
+                    slots[i] = slot.get();
+                }
+                catch (const exc::IException& e)
+                {
+                    lg::Error(std::format("{}\n          When trying to load {}", e.What(), paths[i].string()));
+                }
+            }
+
+            // with fewer files than threads, the spare threads are used to split the files themselves
+            const size_t threadsPerFile = std::max<size_t>(1, util::GetThreadCount(m_loadThreads) / std::max<size_t>(1, paths.size()));
+            const std::vector<std::filesystem::path> imageDirs = m_PlanImageDirs(paths);
+
+            std::vector<String> errors(paths.size());
+            util::ParallelFor(paths.size(), m_loadThreads, [&](size_t i)
+                {
+                    if (!slots[i]) return;
+                    try
+                    {
+                        m_LoadFile(*slots[i], paths[i], threadsPerFile, m_sharedCache, imageDirs[i]);
                     }
-                    else
+                    catch (const exc::IException& e)
+                    {
+                        errors[i] = e.What();
+                    }
+                    catch (const std::exception& e)
                     {
-                        if (m_loadedLocFiles[path.filename().string()].m_file.Open(path, file::FileMode::READ))
-                            m_loadedLocFiles.at(path.filename().string()).m_file.Map();
+                        errors[i] = e.what();
                     }
+                });
+
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                if (!slots[i]) continue;
+                if (errors[i].empty())
+                {
+                    if (m_watcher) m_watcher->Watch(slots[i]->m_path);
+                    continue;
                 }
-                catch (const exc::IException& e)
+
+                lg::Error(std::format("{}\n          When trying to load {}", errors[i], paths[i].string()));
+                m_loadedLocFiles.erase(paths[i].filename().string());
+            }
+
+            m_Rebalance();
+            m_Publish();
+            m_loadSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        }
+
+        Localization::LoadHandle Localization::LoadFilesAsync(std::vector<std::filesystem::path> paths)
+        {
+            auto state = std::make_shared<LoadHandle::State>();
+            state->total = paths.size();
+
+            std::scoped_lock lock(m_writeMutex);
+
+            // loaders that are done only have to return, joining them keeps m_loaders short
+            if (m_pendingLoads.load() == 0) m_loaders.clear();
+
+            // names are reserved right away, so duplicates are reported here like in LoadFiles
+            std::vector<String> names(paths.size());
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                String name = paths[i].filename().string();
+                if (m_loadedLocFiles.contains(name) || std::find(m_pendingNames.begin(), m_pendingNames.end(), name) != m_pendingNames.end())
                 {
-                    lg::Error(std::format("{}\n          When trying to load {}", e.What(), path.string()));
-                    m_loadedLocFiles.erase(path.filename().string());
+                    lg::Error(std::format("Localization file with this name is already loaded\n          When trying to load {}", paths[i].string()));
+                    ++state->failed;
+                    ++state->done;
+                    continue;
                 }
+                m_pendingNames.push_back(name);
+                names[i] = std::move(name);
             }
+
+            std::vector<std::filesystem::path> imageDirs = m_PlanImageDirs(paths);
+            ++m_pendingLoads;
+            m_loaders.emplace_back([this, paths = std::move(paths), names = std::move(names), imageDirs = std::move(imageDirs),
+                threads = m_loadThreads, shared = m_sharedCache, state](std::stop_token stop)
+                {
+                    m_LoadAsync(stop, paths, names, imageDirs, threads, shared, *state);
+                });
+            return LoadHandle(std::move(state));
+        }
+
+        void Localization::LoadHandle::Wait() const
+        {
+            while (!m_state->finished.load()) m_state->finished.wait(false);
+        }
+
+        void Localization::m_LoadAsync(std::stop_token stop, const std::vector<std::filesystem::path>& paths, const std::vector<String>& names,
+            const std::vector<std::filesystem::path>& imageDirs, size_t threads, bool shared, LoadHandle::State& state)
+        {
+            using Clock = std::chrono::steady_clock;
+            constexpr auto PUBLISH_INTERVAL = std::chrono::milliseconds(50);     // rebuilding the tables for every file would cost more than loading them
+
+            const auto begin = Clock::now();
+            const size_t threadsPerFile = std::max<size_t>(1, util::GetThreadCount(threads) / std::max<size_t>(1, paths.size()));
+            Clock::time_point published;    // the first file is published right away
+            bool unpublished = false;
+
+            util::ParallelFor(paths.size(), threads, [&](size_t i)
+                {
+                    if (names[i].empty()) return;   // rejected by LoadFilesAsync
+
+                    auto locFile = std::make_shared<LocFile>();
+                    String error;
+                    if (!stop.stop_requested())
+                    {
+                        try
+                        {
+                            m_LoadFile(*locFile, paths[i], threadsPerFile, shared, imageDirs[i]);
+                        }
+                        catch (const exc::IException& e)
+                        {
+                            error = e.What();
+                        }
+                        catch (const std::exception& e)
+                        {
+                            error = e.what();
+                        }
+                    }
+
+                    std::scoped_lock lock(m_writeMutex);
+                    std::erase(m_pendingNames, names[i]);
+                    if (stop.stop_requested()) return;
+
+                    if (!error.empty())
+                    {
+                        lg::Error(std::format("{}\n          When trying to load {}", error, paths[i].string()));
+                        ++state.failed;
+                    }
+                    else
+                    {
+                        m_loadedLocFiles[names[i]] = std::move(locFile);
+                        if (m_watcher) m_watcher->Watch(m_loadedLocFiles[names[i]]->m_path);
+                        unpublished = true;
+                    }
+                    ++state.done;
+
+                    if (unpublished && Clock::now() - published >= PUBLISH_INTERVAL)
+                    {
+                        m_Publish();
+                        published = Clock::now();
+                        unpublished = false;
+                    }
+                });
+
+            {
+                std::scoped_lock lock(m_writeMutex);
+                if ((!stop.stop_requested() && m_Rebalance()) || unpublished) m_Publish();
+            }
+            m_loadSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+            state.finished = true;
+            state.finished.notify_all();
+            m_pendingLoads.fetch_sub(1);
+            m_pendingLoads.notify_all();
         }
 
         void Localization::UnloadFiles(std::initializer_list<String> fileNames)
         {
+            std::scoped_lock lock(m_writeMutex);
             for (const auto& name : fileNames)
             {
                 try
                 {
-                    if (m_loadedLocFiles.contains(name))
-                        m_loadedLocFiles.erase(name);
-                    else
+                    auto it = m_loadedLocFiles.find(name);
+                    if (it == m_loadedLocFiles.end())
                         throw exc::EngineException(std::format("Failed to unload a localization file (check if the specified file name is correct: {})", name));
+
+                    if (m_watcher) m_watcher->Unwatch(it->second->m_path);
+                    m_loadedLocFiles.erase(name);
                 }
                 catch (const exc::IException& e)
                 {
                     lg::Error(e.What());
                 }
             }
+
+            m_Rebalance();      // what was freed may fit a file that's indexed now
+            m_Publish();
         }
 
         void Localization::UnloadFilesAll()
         {
-            m_loadedLocFiles.clear();   // does clear call dtors? hope it does. TODO: check
+            std::scoped_lock lock(m_writeMutex);
+            if (m_watcher)
+            {
+                for (const auto& [name, locFile] : m_loadedLocFiles) m_watcher->Unwatch(locFile->m_path);
+            }
+            m_loadedLocFiles.clear();   // files are destroyed once the last snapshot using them is gone
+            m_Publish();
         }
 
         void Localization::CreateFileIndex(std::initializer_list<String> fileNames)
@@ -65,33 +252,820 @@ namespace eng
 
         String Localization::GetStrByTag(const String& tag) const
         {
-            return String();
+            return GetStrByTag(TagKey::FromString(tag));
+        }
+
+        String Localization::GetStrByTag(TagKey key) const
+        {
+            if (m_IsPending(key)) return String(PENDING_TEXT);
+            const auto tables = m_tables.Read();
+            return String(m_Lookup(*tables, key));
+        }
+
+        std::string_view Localization::GetStrView(TagKey key) const
+        {
+            if (m_IsPending(key)) return PENDING_TEXT;
+            return m_Lookup(*m_tables.Read(), key);
+        }
+
+        void Localization::GetStrViews(std::span<const TagKey> keys, std::span<std::string_view> out) const
+        {
+            if (out.size() < keys.size())
+                throw exc::EngineException(std::format("GetStrViews: {} keys don't fit into {} results", keys.size(), out.size()));
+
+            // placeholders and waiting are decided per tag
+            if (IsLoading())
+            {
+                for (size_t i = 0; i < keys.size(); ++i) out[i] = GetStrView(keys[i]);
+                return;
+            }
+            m_LookupBatch(*m_tables.Read(), keys, out);
+        }
+
+        void Localization::GetStrViews(std::span<const std::string_view> tags, std::span<std::string_view> out) const
+        {
+            if (out.size() < tags.size())
+                throw exc::EngineException(std::format("GetStrViews: {} tags don't fit into {} results", tags.size(), out.size()));
+
+            std::vector<TagKey> keys;
+            keys.reserve(tags.size());
+            for (std::string_view tag : tags) keys.push_back(TagKey::FromString(tag));
+            GetStrViews(keys, out);
+        }
+
+        String Localization::GetStrByTag(TagKey key, TagKey var) const
+        {
+            if (m_IsPending(key)) return String(PENDING_TEXT);
+            const auto tables = m_tables.Read();
+            return String(m_Lookup(*tables, key, &var));
+        }
+
+        std::string_view Localization::GetStrView(TagKey key, TagKey var) const
+        {
+            if (m_IsPending(key)) return PENDING_TEXT;
+            return m_Lookup(*m_tables.Read(), key, &var);
+        }
+
+        bool Localization::HasTag(TagKey key) const
+        {
+            return m_tables.Read()->tagIndices.contains(key.GetHash());
+        }
+
+        bool Localization::IsLoading() const
+        {
+            return m_pendingLoads.load() > 0;
+        }
+
+        void Localization::SetPendingPolicy(PendingPolicy policy)
+        {
+            m_pendingPolicy.store(policy);
+        }
+
+        bool Localization::m_IsPending(TagKey key) const
+        {
+            // one load while nothing is loading in the background
+            for (size_t pending; (pending = m_pendingLoads.load()) > 0;)
+            {
+                if (HasTag(key)) return false;
+                if (m_pendingPolicy.load(std::memory_order_relaxed) == PendingPolicy::PLACEHOLDER) return true;
+                m_pendingLoads.wait(pending);
+            }
+            return false;
         }
 
         String Localization::GetFileContents(const String& fileName)
         {
-            return m_loadedLocFiles.at(fileName).m_file.GetContent();
+            std::scoped_lock lock(m_writeMutex);
+            LocFile& locFile = *m_loadedLocFiles.at(fileName);
+            if (locFile.m_binFile.IsShared()) return file::File().Read(locFile.m_path);
+            return locFile.m_compiled ? locFile.m_binFile.GetContent() : locFile.m_file.GetContent();
         }
 
         uint16_t Localization::GetLoadedFilesNum() const
         {
-            return m_loadedLocFiles.size();
+            return static_cast<uint16_t>(m_tables.Read()->files.size());
         }
 
         void Localization::SetLanguage(Language lang)
         {
-            m_gameLang = lang;
+            m_gameLang.store(lang, std::memory_order_relaxed);
             // TODO: save new lang to config
         }
 
         Language Localization::GetLanguage()
         {
-            return m_gameLang;
+            return m_gameLang.load(std::memory_order_relaxed);
+        }
+
+        void Localization::SetLoadThreads(size_t count)
+        {
+            m_loadThreads = count;
+        }
+
+        Localization::ReadHandle Localization::Read() const
+        {
+            return ReadHandle(*this);
+        }
+
+        void Localization::EnableHotReload(bool enable)
+        {
+            std::unique_ptr<file::FileWatcher> old;
+            {
+                std::scoped_lock lock(m_writeMutex);
+                if (enable == (m_watcher != nullptr)) return;
+
+                if (enable)
+                {
+                    m_watcher = std::make_unique<file::FileWatcher>([this](const std::filesystem::path& path) { m_ReloadFile(path); });
+                    for (const auto& [name, locFile] : m_loadedLocFiles) m_watcher->Watch(locFile->m_path);
+                }
+                else old = std::move(m_watcher);
+            }
+            // destroyed outside the lock, it waits for a reload that may be waiting for the lock
+            old.reset();
+        }
+
+        void Localization::EnableSharedCache(bool enable)
+        {
+            std::scoped_lock lock(m_writeMutex);
+            m_sharedCache = enable;
+        }
+
+        void Localization::SetMemoryBudget(size_t bytes, std::filesystem::path imageDir)
+        {
+            std::scoped_lock lock(m_writeMutex);
+            m_memoryBudget = bytes;
+            m_imageDir = imageDir.empty() ? std::filesystem::temp_directory_path() / "space_ltfb" : std::move(imageDir);
+            if (m_Rebalance()) m_Publish();
+        }
+
+        void Localization::RebalanceMemory()
+        {
+            std::scoped_lock lock(m_writeMutex);
+            if (m_Rebalance()) m_Publish();
+        }
+
+        std::vector<std::filesystem::path> Localization::m_PlanImageDirs(std::span<const std::filesystem::path> paths) const
+        {
+            std::vector<std::filesystem::path> dirs(paths.size());
+            if (m_memoryBudget == 0) return dirs;
+
+            // in the order given, the first files that fit are parsed into maps
+            size_t heap = 0;
+            for (const auto& [name, locFile] : m_loadedLocFiles) heap += m_FileHeapBytes(*locFile);
+            const double cost = m_MapCost();
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                if (paths[i].extension() == ".ltfb") continue;
+
+                std::error_code ec;
+                const size_t size = std::filesystem::file_size(paths[i], ec);
+                const size_t estimate = ec ? 0 : static_cast<size_t>(static_cast<double>(size) * cost);
+                if (heap + estimate <= m_memoryBudget) heap += estimate;
+                else dirs[i] = m_imageDir;
+            }
+            return dirs;
+        }
+
+        bool Localization::m_Rebalance()
+        {
+            struct Candidate
+            {
+                String                      name;
+                std::shared_ptr<LocFile>    file;
+                size_t                      mapBytes;   // it takes, or would take, as a map
+                double                      heat;       // sampled lookups per byte of the map
+            };
+
+            size_t heap = 0;
+            const double cost = m_MapCost();
+            std::vector<Candidate> maps, images;
+            for (auto& [name, locFile] : m_loadedLocFiles)
+            {
+                heap += m_FileHeapBytes(*locFile);
+
+                // older lookups count less every time
+                const uint64_t lookups = locFile->m_lookups.load(std::memory_order_relaxed);
+                locFile->m_lookups.store(lookups / 2, std::memory_order_relaxed);
+
+                if (locFile->m_indexed)
+                {
+                    std::error_code ec;
+                    const size_t size = std::filesystem::file_size(locFile->m_path, ec);
+                    const size_t estimate = ec ? 0 : static_cast<size_t>(static_cast<double>(size) * cost);
+                    images.push_back({ name, locFile, estimate, static_cast<double>(lookups) / std::max<size_t>(estimate, 1) });
+                }
+                else if (!locFile->m_compiled)
+                {
+                    maps.push_back({ name, locFile, locFile->m_heapBytes, static_cast<double>(lookups) / std::max<size_t>(locFile->m_heapBytes, 1) });
+                }
+            }
+
+            // the file is loaded again in the other mode, the old version stays if that fails
+            bool changed = false;
+            auto move = [&](const Candidate& candidate, bool index)
+                {
+                    auto locFile = std::make_shared<LocFile>();
+                    try
+                    {
+                        m_LoadFile(*locFile, candidate.file->m_path, m_loadThreads, false, index ? m_imageDir : std::filesystem::path());
+                    }
+                    catch (const exc::IException& e)
+                    {
+                        lg::Error(std::format("{}\n          When trying to reload {} for the memory budget", e.What(), candidate.file->m_path.string()));
+                        return false;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        lg::Error(std::format("{}\n          When trying to reload {} for the memory budget", e.what(), candidate.file->m_path.string()));
+                        return false;
+                    }
+                    if (index && !locFile->m_indexed) return false;     // the image couldn't be made
+
+                    locFile->m_lookups = candidate.file->m_lookups.load();
+                    m_loadedLocFiles[candidate.name] = locFile;
+                    changed = true;
+                    lg::Info(std::format("Localization: {} is {} for the memory budget ({:.2f} MB as a map)", candidate.name,
+                        index ? "indexed" : "parsed into a map", candidate.mapBytes / (1024.0 * 1024.0)));
+                    return true;
+                };
+
+            // the coldest maps are indexed until the rest fits
+            std::sort(maps.begin(), maps.end(), [](const Candidate& a, const Candidate& b) { return a.heat < b.heat; });
+            for (const Candidate& candidate : maps)
+            {
+                if (m_memoryBudget == 0 || heap <= m_memoryBudget) break;
+                if (move(candidate, true)) heap -= std::min(heap, candidate.mapBytes);
+            }
+
+            // then the hottest indexed files are parsed into maps while they fit (all of them without a budget),
+            // files nobody looked up aren't worth the memory
+            std::sort(images.begin(), images.end(), [](const Candidate& a, const Candidate& b) { return a.heat > b.heat; });
+            for (const Candidate& candidate : images)
+            {
+                if (m_memoryBudget != 0 && (candidate.heat == 0 || heap + candidate.mapBytes > m_memoryBudget)) continue;
+                if (move(candidate, false)) heap += m_loadedLocFiles.at(candidate.name)->m_heapBytes;
+            }
+            return changed;
+        }
+
+        double Localization::m_MapCost() const
+        {
+            size_t heap = 0, bytes = 0;
+            for (const auto& [name, locFile] : m_loadedLocFiles)
+            {
+                if (locFile->m_compiled) continue;
+                heap += locFile->m_heapBytes;
+                bytes += locFile->m_file.GetSize();
+            }
+            // small files cost mostly the arena's first block, they'd make every file look too expensive
+            return bytes >= MIN_MAP_COST_BYTES ? static_cast<double>(heap) / static_cast<double>(bytes) : DEFAULT_MAP_COST;
+        }
+
+        size_t Localization::m_FileHeapBytes(const LocFile& locFile)
+        {
+            return locFile.m_compiled ? locFile.m_binFile.GetDecodedBytes() : locFile.m_heapBytes;
+        }
+
+        Localization::Stats Localization::GetStats() const
+        {
+            // loaded files never change, the tables keep the ones they were built from alive
+            const auto tables = m_tables.Read();
+
+            Stats stats;
+            stats.tags = tables->tags.size();
+            stats.templates = tables->templates.size();
+            stats.tableBytes = m_TableBytes(*tables);
+            stats.missing = tables->missing;
+            stats.loadSeconds = m_loadSeconds.load();
+            stats.memoryBudget = m_memoryBudget.load();
+            stats.buildSeconds = tables->buildSeconds;
+
+            for (const auto& locFile : tables->files)
+            {
+                FileStats& file = stats.files.emplace_back();
+                file.name = locFile->m_path.filename().string();
+                file.compiled = locFile->m_compiled;
+                file.indexed = locFile->m_indexed;
+                file.stats = locFile->m_compiled ? locFile->m_binFile.GetStats() : locFile->m_file.GetStats();
+
+                file::LtfStats& total = stats.total;
+                total.mappedBytes += file.stats.mappedBytes;
+                total.residentBytes += file.stats.residentBytes;
+                total.mapBytes += file.stats.mapBytes;
+                total.indexBytes += file.stats.indexBytes;
+                total.cacheBytes += file.stats.cacheBytes;
+                total.entries += file.stats.entries;
+                total.parseSeconds += file.stats.parseSeconds;
+                total.indexSeconds += file.stats.indexSeconds;
+                for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan) total.texts[lan] += file.stats.texts[lan];
+            }
+            return stats;
+        }
+
+        void Localization::LogStats() const
+        {
+            constexpr double MB = 1024.0 * 1024.0;
+            const Stats stats = GetStats();
+
+            lg::Info(std::format("Localization: {} files, {} tags, {} templates, last load {:.1f} ms (tables {:.1f} ms)",
+                stats.files.size(), stats.tags, stats.templates, stats.loadSeconds * 1e3, stats.buildSeconds * 1e3));
+            for (const FileStats& file : stats.files)
+            {
+                lg::Info(std::format("  {}: {}, {} ids, {:.2f} MB mapped ({:.2f} MB resident), {:.2f} MB heap, parsed in {:.1f} ms",
+                    file.name, file.indexed ? "indexed" : file.compiled ? "compiled" : "map", file.stats.entries, file.stats.mappedBytes / MB,
+                    file.stats.residentBytes / MB, file.stats.GetHeapBytes() / MB, file.stats.parseSeconds * 1e3));
+            }
+
+            const file::LtfStats& total = stats.total;
+            if (stats.memoryBudget) lg::Info(std::format("  memory budget: {:.2f} MB, {:.2f} MB used", stats.memoryBudget / MB, total.GetHeapBytes() / MB));
+            lg::Info(std::format("  total: {:.2f} MB mapped ({:.2f} MB resident), {:.2f} MB heap (maps {:.2f}, indices {:.2f}, decoded {:.2f}, tables {:.2f})",
+                total.mappedBytes / MB, total.residentBytes / MB, stats.GetHeapBytes() / MB,
+                total.mapBytes / MB, total.indexBytes / MB, total.cacheBytes / MB, stats.tableBytes / MB));
+
+            String texts;
+            for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan)
+            {
+                if (total.texts[lan] == 0) continue;
+                texts += std::format("{}{} {} ({} missing)", texts.empty() ? "" : ", ", lang::GetLanguageCodeStr(static_cast<Language>(lan)),
+                    total.texts[lan], stats.missing[lan]);
+            }
+            if (!texts.empty()) lg::Info(std::format("  texts: {}", texts));
+        }
+
+        void Localization::m_LoadFile(LocFile& locFile, const std::filesystem::path& path, size_t threads, bool shared,
+            const std::filesystem::path& imageDir, const LocFile* previous)
+        {
+            locFile.m_path = file::FileWatcher::Normalize(path);
+            locFile.m_file.SetParseThreads(threads);
+
+            bool loaded = false;
+            if (path.extension() == ".ltfb")
+            {
+                locFile.m_compiled = true;
+                loaded = locFile.m_binFile.Prepare(path);
+            }
+            else if (shared && locFile.m_binFile.PrepareShared(locFile.m_path))     // parsed below if shared memory can't be used
+            {
+                locFile.m_compiled = true;
+                loaded = true;
+            }
+            else if (!imageDir.empty() && locFile.m_binFile.PrepareCached(locFile.m_path, imageDir))   // the same if the image can't be written
+            {
+                locFile.m_compiled = true;
+                locFile.m_indexed = true;
+                loaded = true;
+            }
+            else if (previous && !previous->m_compiled)
+            {
+                loaded = locFile.m_file.Prepare(path) && locFile.m_file.UpdateMap(previous->m_file);
+            }
+            else loaded = locFile.m_file.Prepare(path) && locFile.m_file.CreateMapAll();
+
+            if (!loaded) throw exc::EngineException("Failed to parse the localization file");
+            if (!locFile.m_compiled) locFile.m_heapBytes = locFile.m_file.GetStats().GetHeapBytes();
         }
 
-        void Localization::m_ParseFile()
+        void Localization::m_ReloadFile(const std::filesystem::path& path)
         {
+            using Clock = std::chrono::steady_clock;
+            const auto begin = Clock::now();
+
+            std::scoped_lock lock(m_writeMutex);
+            const String name = path.filename().string();
+            auto it = m_loadedLocFiles.find(name);
+            if (it == m_loadedLocFiles.end() || it->second->m_path != path) return;    // unloaded in the meantime
 
+            // the old version stays loaded (and in use) if the new one fails
+            auto locFile = std::make_shared<LocFile>();
+            try
+            {
+                m_LoadFile(*locFile, path, m_loadThreads, m_sharedCache, it->second->m_indexed ? m_imageDir : std::filesystem::path(), it->second.get());
+            }
+            catch (const exc::IException& e)
+            {
+                lg::Error(std::format("{}\n          When trying to reload {}, the previous version is kept", e.What(), path.string()));
+                return;
+            }
+            catch (const std::exception& e)
+            {
+                lg::Error(std::format("{}\n          When trying to reload {}, the previous version is kept", e.what(), path.string()));
+                return;
+            }
+
+            const auto parsed = Clock::now();
+            it->second = std::move(locFile);
+            m_Publish();
+            const auto published = Clock::now();
+            m_loadSeconds = std::chrono::duration<double>(published - begin).count();
+
+            const LocFile& loaded = *m_loadedLocFiles.at(name);
+            lg::Info(std::format("Reloaded {} in {:.1f} ms (parsing {:.1f} ms, {} of {} entries; tables {:.1f} ms)",
+                name, std::chrono::duration<double, std::milli>(published - begin).count(),
+                std::chrono::duration<double, std::milli>(parsed - begin).count(),
+                loaded.m_compiled ? loaded.m_binFile.GetTagCount() : loaded.m_file.GetParsedEntryCount(),
+                loaded.m_compiled ? loaded.m_binFile.GetTagCount() : loaded.m_file.GetMap().size(),
+                std::chrono::duration<double, std::milli>(published - parsed).count()));
+        }
+
+        void Localization::m_Publish()
+        {
+            // waits for readers of the old tables, unless this thread is one of them
+            auto tables = m_BuildTables(m_loadedLocFiles);
+            m_ReportMissing(*tables);
+            m_tables.Publish(std::move(tables));
+        }
+
+        void Localization::m_ReportMissing(const Tables& tables)
+        {
+            if (tables.missing == m_reportedMissing || tables.tags.empty()) return;
+            m_reportedMissing = tables.missing;
+
+            String report;
+            for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan)
+            {
+                if (tables.missing[lan] == 0) continue;
+                report += std::format("{}{} in {}", report.empty() ? "" : ", ", tables.missing[lan], lang::GetLanguageCodeStr(static_cast<Language>(lan)));
+            }
+            if (report.empty()) lg::Info(std::format("Localization: every tag is translated ({} variation texts fall back to the default)", tables.fallbacks));
+            else lg::Warning(std::format("Localization: tags without translation: {} ({} variation texts fall back to the default)", report, tables.fallbacks));
+        }
+
+        std::unique_ptr<const Localization::Tables> Localization::m_BuildTables(const LocFileMap& files)
+        {
+            const auto begin = std::chrono::steady_clock::now();
+            auto tables = std::make_unique<Tables>();
+            for (const auto& [name, locFile] : files)
+            {
+                tables->files.push_back(locFile);
+                if (locFile->m_compiled)
+                {
+                    const auto& bin = locFile->m_binFile;
+                    for (uint32_t entry = 0; entry < bin.GetEntryCount(); ++entry)
+                    {
+                        if (!bin.GetTag(entry).empty()) m_AddTag(*tables, *locFile, bin.GetTag(entry), nullptr, entry);
+                    }
+                }
+                else
+                {
+                    for (const auto& [tag, str] : locFile->m_file.GetMap()) m_AddTag(*tables, *locFile, tag, &str, 0);
+                }
+            }
+
+            m_BuildStringTables(*tables);
+            m_BuildTemplates(*tables);
+            tables->buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            return tables;
+        }
+
+        size_t Localization::m_TableBytes(const Tables& tables)
+        {
+            size_t bytes = tables.files.capacity() * sizeof(tables.files[0])
+                + tables.tags.capacity() * sizeof(TagRef) + tables.tagIndices.allocated_bytes()
+                + tables.strings.capacity() * sizeof(StringTable) + tables.variationIds.allocated_bytes()
+                + tables.tableOf.capacity() * sizeof(int32_t)
+                + tables.templates.capacity() * sizeof(Template) + tables.templateOps.capacity() * sizeof(file::itrn::InsertOp)
+                + tables.templateIds.allocated_bytes();
+            for (const StringTable& table : tables.strings)
+            {
+                bytes += table.strings.capacity() * sizeof(std::string_view) + table.templates.capacity() * sizeof(uint32_t)
+                    + file::itrn::StringHeapBytes(table.var);
+            }
+            return bytes;
+        }
+
+        void Localization::m_AddTag(Tables& tables, const LocFile& file, std::string_view tag, const file::itrn::MultiStr* str, uint32_t entry)
+        {
+            auto [it, added] = tables.tagIndices.try_emplace(TagKey::FromString(tag).GetHash(), static_cast<uint32_t>(tables.tags.size()));
+            if (added)
+            {
+                tables.tags.push_back({ &file, str, entry, tag });
+                return;
+            }
+
+            if (tables.tags[it->second].tag != tag)
+                lg::Error(std::format("Localization tag hash collision: [{}] and [{}], [{}] will not be reachable", tables.tags[it->second].tag, tag, tag));
+            else
+                lg::Warning(std::format("Localization tag [{}] is defined in several files, only one of them is used", tag));
+        }
+
+        void Localization::m_BuildStringTables(Tables& tables)
+        {
+            auto tableFor = [&tables](Language lan, std::string_view var) -> StringTable&
+                {
+                    for (auto& table : tables.strings)
+                    {
+                        if (table.lan == lan && table.var == var) return table;
+                    }
+                    std::vector<std::string_view> strings(tables.tags.size(), file::itrn::MISSING_TRANSLATION);
+                    return tables.strings.emplace_back(StringTable{ lan, String(var), std::move(strings), {} });
+                };
+
+            for (uint32_t i = 0; i < tables.tags.size(); ++i)
+            {
+                const TagRef& ref = tables.tags[i];
+                if (ref.file->m_compiled)
+                {
+                    const auto& bin = ref.file->m_binFile;
+                    for (uint32_t col = 0; col < bin.GetColumnCount(); ++col)
+                    {
+                        auto text = bin.GetColumnText(ref.entry, col);
+                        if (text) tableFor(bin.GetColumn(col).first, bin.GetColumn(col).second).strings[i] = *text;
+                    }
+                }
+                else
+                {
+                    for (const auto& item : ref.str->GetItems()) tableFor(item.lan, item.var).strings[i] = item.text;
+                }
+            }
+
+            // every (language, variation) gets a table: its own, or the default variation's of the language
+            std::vector<uint64_t> varHashes;
+            for (const auto& table : tables.strings)
+            {
+                if (!table.var.empty() && tables.variationIds.try_emplace(util::Fnv1a(table.var), static_cast<uint32_t>(varHashes.size() + 1)).second)
+                    varHashes.push_back(util::Fnv1a(table.var));
+            }
+
+            tables.tableOf.assign((varHashes.size() + 1) * LANGUAGE_COUNT, -1);
+            for (size_t t = 0; t < tables.strings.size(); ++t)
+            {
+                if (tables.strings[t].var.empty())
+                    tables.tableOf[static_cast<size_t>(tables.strings[t].lan)] = static_cast<int32_t>(t);
+            }
+            for (size_t t = 0; t < tables.strings.size(); ++t)
+            {
+                StringTable& table = tables.strings[t];
+                if (table.var.empty()) continue;
+
+                const size_t lan = static_cast<size_t>(table.lan);
+                tables.tableOf[tables.variationIds.at(util::Fnv1a(table.var)) * LANGUAGE_COUNT + lan] = static_cast<int32_t>(t);
+
+                // text the variation doesn't have is taken from the default one
+                const int32_t def = tables.tableOf[lan];
+                if (def < 0) continue;
+                for (size_t i = 0; i < table.strings.size(); ++i)
+                {
+                    const std::string_view text = tables.strings[def].strings[i];
+                    if (table.strings[i].data() == file::itrn::MISSING_TRANSLATION.data() && text.data() != file::itrn::MISSING_TRANSLATION.data())
+                    {
+                        table.strings[i] = text;
+                        ++tables.fallbacks;
+                    }
+                }
+            }
+            for (size_t v = 1; v <= varHashes.size(); ++v)
+            {
+                for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan)
+                {
+                    if (tables.tableOf[v * LANGUAGE_COUNT + lan] < 0) tables.tableOf[v * LANGUAGE_COUNT + lan] = tables.tableOf[lan];
+                }
+            }
+
+            for (size_t lan = 0; lan < LANGUAGE_COUNT; ++lan)
+            {
+                if (tables.tableOf[lan] < 0) continue;
+                for (std::string_view text : tables.strings[tables.tableOf[lan]].strings)
+                {
+                    if (text.data() == file::itrn::MISSING_TRANSLATION.data()) ++tables.missing[lan];
+                }
+            }
+        }
+
+        const Localization::StringTable* Localization::m_TableOf(const Tables& tables, const TagKey* var)
+        {
+            size_t index = static_cast<size_t>(m_gameLang.load(std::memory_order_relaxed));
+            if (var)
+            {
+                // unknown variations fall back to the default one
+                auto it = tables.variationIds.find(var->GetHash());
+                if (it != tables.variationIds.end()) index += it->second * LANGUAGE_COUNT;
+            }
+
+            const int32_t table = tables.tableOf[index];
+            return table >= 0 ? &tables.strings[table] : nullptr;
+        }
+
+        std::string_view Localization::m_Lookup(const Tables& tables, TagKey key, const TagKey* var)
+        {
+            auto it = tables.tagIndices.find(key.GetHash());
+            if (it == tables.tagIndices.end()) return file::itrn::MISSING_TRANSLATION;
+
+            m_CountLookup(tables, it->second);
+            const StringTable* table = m_TableOf(tables, var);
+            return table ? table->strings[it->second] : file::itrn::MISSING_TRANSLATION;
+        }
+
+        void Localization::m_CountLookup(const Tables& tables, uint32_t tag)
+        {
+            // a counter shared by all threads on every lookup would cost more than the lookup
+            thread_local uint32_t lookups = 0;
+            if (++lookups % LOOKUP_SAMPLE == 0) tables.tags[tag].file->m_lookups.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Localization::m_LookupBatch(const Tables& tables, std::span<const TagKey> keys, std::span<std::string_view> out)
+        {
+            // lookups in flight at once: enough to hide memory latency, few enough that what was
+            // prefetched for the first one is still in cache when it's resolved
+            constexpr size_t GROUP = 32;
+            constexpr uint32_t NOT_FOUND = 0xFFFFFFFF;
+
+            const auto& indices = tables.tagIndices;
+            const StringTable* table = m_TableOf(tables, nullptr);
+            std::array<uint64_t, GROUP> hashes;
+            std::array<uint32_t, GROUP> found;
+
+            for (size_t begin = 0; begin < keys.size(); begin += GROUP)
+            {
+                const size_t count = std::min(GROUP, keys.size() - begin);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    hashes[i] = indices.hash_of(keys[begin + i].GetHash());
+                    indices.prefetch(hashes[i]);
+                }
+                for (size_t i = 0; i < count; ++i) indices.prefetch_value(hashes[i]);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    auto it = indices.find(keys[begin + i].GetHash(), hashes[i]);
+                    found[i] = it == indices.end() ? NOT_FOUND : it->second;
+                    if (table && found[i] != NOT_FOUND) util::Prefetch(&table->strings[found[i]]);
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    out[begin + i] = table && found[i] != NOT_FOUND ? table->strings[found[i]] : file::itrn::MISSING_TRANSLATION;
+                    if (found[i] != NOT_FOUND) m_CountLookup(tables, found[i]);
+                }
+            }
+        }
+
+        void Localization::m_BuildTemplates(Tables& tables)
+        {
+            for (const TagRef& ref : tables.tags)
+            {
+                if (ref.file->m_compiled)
+                {
+                    const auto& bin = ref.file->m_binFile;
+                    for (uint32_t col = 0; col < bin.GetColumnCount(); ++col)
+                    {
+                        auto text = bin.GetColumnText(ref.entry, col);
+                        if (text) m_AddTemplate(tables, ref.tag, bin.GetColumn(col).first, bin.GetColumn(col).second, *text);
+                    }
+                }
+                else
+                {
+                    for (const auto& item : ref.str->GetItems()) m_AddTemplate(tables, ref.tag, item.lan, item.var, item.text);
+                }
+            }
+
+            // references between templates are expanded here, so formatting never has to follow them
+            m_CompileTemplates(tables);
+
+            // templates of every tag in every table, with the same fallback as the text
+            for (StringTable& table : tables.strings)
+            {
+                const uint64_t var = table.var.empty() ? 0 : util::Fnv1a(table.var);
+                table.templates.assign(tables.tags.size(), NO_TEMPLATE);
+                for (uint32_t i = 0; i < tables.tags.size(); ++i)
+                {
+                    const uint64_t tag = util::Fnv1a(tables.tags[i].tag);
+                    auto it = tables.templateIds.find({ tag, table.lan, var });
+                    if (it == tables.templateIds.end() && var) it = tables.templateIds.find({ tag, table.lan, 0 });
+                    if (it != tables.templateIds.end()) table.templates[i] = it->second;
+                }
+            }
+        }
+
+        void Localization::m_AddTemplate(Tables& tables, std::string_view tag, Language lan, std::string_view var, std::string_view text)
+        {
+            TemplateKey key{ util::Fnv1a(tag), lan, var.empty() ? 0 : util::Fnv1a(var) };
+            if (tables.templateIds.try_emplace(key, static_cast<uint32_t>(tables.templates.size())).second)
+                tables.templates.push_back({ tag, text, lan });
+        }
+
+        void Localization::m_CompileTemplates(Tables& tables)
+        {
+            using namespace file::itrn;
+
+            const size_t count = tables.templates.size();
+            auto where = [&](uint32_t index)
+                {
+                    return std::format("[{}] ({})", tables.templates[index].tag, lang::GetLanguageCodeStr(tables.templates[index].lan));
+                };
+
+            // every template is parsed once, references are resolved to template indices
+            // (falling back to the default variation) or replaced with the missing text
+            std::vector<std::vector<InsertOp>> raw(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                Template& tmpl = tables.templates[i];
+                try
+                {
+                    CompileInserts(tmpl.text, raw[i]);
+                }
+                catch (const exc::IException& e)
+                {
+                    lg::Error(std::format("{}\n          In {}", e.What(), where(i)));
+                    raw[i] = { InsertOp{ InsertOpType::LITERAL, 0, 0, tmpl.text } };
+                }
+
+                for (InsertOp& op : raw[i])
+                {
+                    if (op.type != InsertOpType::REF) continue;
+
+                    size_t dot = op.text.find(DOT);
+                    std::string_view refTag = op.text.substr(0, dot);
+                    std::string_view refVar = dot == op.text.npos ? std::string_view() : op.text.substr(dot + 1);
+
+                    auto target = tables.templateIds.find({ util::Fnv1a(refTag), tmpl.lan, refVar.empty() ? 0 : util::Fnv1a(refVar) });
+                    if (target == tables.templateIds.end()) target = tables.templateIds.find({ util::Fnv1a(refTag), tmpl.lan, 0 });
+                    if (target == tables.templateIds.end()) op = { InsertOpType::LITERAL, 0, 0, MISSING_TRANSLATION };
+                    else op.ref = target->second;
+                }
+            }
+
+            // depth first walk over the references without recursion (chains can be as long as the files make them),
+            // a template is compiled when everything it references is, so every reference can be expanded in place.
+            // a reference back to a template that's still on the stack closes a cycle, it's reported with the whole
+            // path and replaced with the missing text
+            struct Frame
+            {
+                uint32_t    index;
+                size_t      nextOp;
+            };
+            std::vector<Frame> stack;
+
+            for (uint32_t root = 0; root < count; ++root)
+            {
+                if (tables.templates[root].state != Template::State::RAW) continue;
+                tables.templates[root].state = Template::State::COMPILING;
+                stack.push_back({ root, 0 });
+
+                while (!stack.empty())
+                {
+                    Frame& frame = stack.back();
+                    std::vector<InsertOp>& ops = raw[frame.index];
+
+                    while (frame.nextOp < ops.size() && ops[frame.nextOp].type != InsertOpType::REF) ++frame.nextOp;
+                    if (frame.nextOp < ops.size())
+                    {
+                        InsertOp& op = ops[frame.nextOp++];
+                        Template& target = tables.templates[op.ref];
+                        if (target.state == Template::State::RAW)
+                        {
+                            target.state = Template::State::COMPILING;
+                            stack.push_back({ op.ref, 0 });     // invalidates frame
+                        }
+                        else if (target.state == Template::State::COMPILING)
+                        {
+                            std::string path;
+                            auto first = std::find_if(stack.begin(), stack.end(), [&](const Frame& f) { return f.index == op.ref; });
+                            for (auto it = first; it != stack.end(); ++it) path += std::format("[{}] -> ", tables.templates[it->index].tag);
+                            lg::Error(std::format("Localization insert cycle: {}[{}] ({})", path, target.tag, lang::GetLanguageCodeStr(target.lan)));
+                            op = { InsertOpType::LITERAL, 0, 0, MISSING_TRANSLATION };
+                        }
+                        continue;
+                    }
+
+                    // everything referenced is compiled, expand it with its arguments moved after ours
+                    const uint32_t index = frame.index;
+                    stack.pop_back();
+
+                    std::vector<InsertOp> flat;
+                    uint32_t nextArg = 0;
+                    for (const InsertOp& op : ops)
+                    {
+                        if (op.type == InsertOpType::LITERAL) flat.push_back(op);
+                        else if (op.type == InsertOpType::ARG) flat.push_back({ InsertOpType::ARG, static_cast<uint16_t>(nextArg++), 0, {} });
+                        else
+                        {
+                            const Template& ref = tables.templates[op.ref];
+                            for (uint32_t k = ref.firstOp; k < ref.firstOp + ref.opCount; ++k)
+                            {
+                                InsertOp refOp = tables.templateOps[k];
+                                if (refOp.type == InsertOpType::ARG) refOp.arg = static_cast<uint16_t>(refOp.arg + nextArg);
+                                flat.push_back(refOp);
+                            }
+                            nextArg += ref.argCount;
+                        }
+                    }
+
+                    // references repeated at every level grow exponentially, such text is an error in the file
+                    if (flat.size() > MAX_TEMPLATE_OPS || nextArg > UINT16_MAX)
+                    {
+                        lg::Error(std::format("Localization insert error: {} expands to more than {} parts", where(index), MAX_TEMPLATE_OPS));
+                        flat = { InsertOp{ InsertOpType::LITERAL, 0, 0, MISSING_TRANSLATION } };
+                        nextArg = 0;
+                    }
+
+                    Template& tmpl = tables.templates[index];
+                    tmpl.firstOp = static_cast<uint32_t>(tables.templateOps.size());
+                    tmpl.opCount = static_cast<uint32_t>(flat.size());
+                    tmpl.argCount = static_cast<uint16_t>(nextArg);
+                    tmpl.state = Template::State::READY;
+                    tables.templateOps.insert(tables.templateOps.end(), flat.begin(), flat.end());
+                    raw[index] = {};
+                }
+            }
         }
     }
 }
\ No newline at end of file
@@ -2,6 +2,12 @@
 
 #include "../core/Core.h"
 #include "../core/Language.h"
+#include "../core/Ltf.h"
+#include "../core/StringUtil.h"
+#include "../core/Parallel.h"
+#include "../core/FlatMap.h"
+#include "../core/FileWatcher.h"
+#include "../core/Rcu.h"
 
 #include <initializer_list>
 #include <vector>
@@ -10,6 +16,13 @@
 #include <utility>
 #include <format>
 #include <cstdint>
+#include <string_view>
+#include <span>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace eng
 {
@@ -17,39 +30,460 @@ namespace eng
     {
         using namespace lang;
 
+        // hashed tag, use "tag"_tag for tags known at compile time (hashed by the compiler)
+        // and TagKey::FromString for dynamic ones
+        class TagKey
+        {
+        public:
+            static constexpr TagKey FromString(std::string_view tag) { return TagKey(util::Fnv1a(tag)); }
+            constexpr uint64_t      GetHash() const { return m_hash; }
+
+            friend constexpr bool operator==(TagKey lhs, TagKey rhs) { return lhs.m_hash == rhs.m_hash; }
+
+        private:
+            constexpr explicit TagKey(uint64_t hash) : m_hash(hash) {}
+            uint64_t m_hash;
+        };
+
+        inline namespace literals
+        {
+            consteval TagKey operator""_tag(const char* tag, size_t len) { return TagKey::FromString(std::string_view(tag, len)); }
+        }
+
+        namespace itrn
+        {
+            // "{0}", "{1}", ... used to format a single argument out of std::format_args
+            inline constexpr auto ARG_FORMATS = []
+                {
+                    std::array<std::array<char, 5>, 100> formats{};
+                    for (size_t i = 0; i < formats.size(); ++i)
+                    {
+                        size_t n = 0;
+                        formats[i][n++] = '{';
+                        if (i >= 10) formats[i][n++] = static_cast<char>('0' + i / 10);
+                        formats[i][n++] = static_cast<char>('0' + i % 10);
+                        formats[i][n++] = '}';
+                    }
+                    return formats;
+                }();
+
+            // output iterator over a fixed buffer, drops everything that doesn't fit
+            struct BufferIt
+            {
+                using difference_type = std::ptrdiff_t;
+
+                char*   cur = nullptr;
+                char*   end = nullptr;
+                size_t  written = 0;
+
+                BufferIt& operator*() { return *this; }
+                BufferIt& operator++() { return *this; }
+                BufferIt& operator++(int) { return *this; }
+                BufferIt& operator=(char c)
+                {
+                    if (cur != end) *cur++ = c;
+                    ++written;
+                    return *this;
+                }
+            };
+        }
+
+        // what lookups of tags that aren't loaded yet do while LoadFilesAsync is running
+        enum class PendingPolicy
+        {
+            PLACEHOLDER,    // return PENDING_TEXT (the default)
+            WAIT,           // block until every running load is finished
+        };
+
+        inline constexpr std::string_view PENDING_TEXT = "...";
+
         class Localization
         {
         public:
+            class LoadHandle;
+
+            // what the loaded files and the tables built from them cost, see GetStats
+            struct FileStats
+            {
+                String              name;
+                bool                compiled = false;       // .ltfb or an image of an .ltf, else an .ltf parsed into a map
+                bool                indexed = false;        // an .ltf read from its image because of the memory budget
+                file::LtfStats      stats;
+            };
+
+            struct Stats
+            {
+                std::vector<FileStats>  files;
+                file::LtfStats          total;              // of all files, seconds are summed up
+                size_t                  tags = 0;
+                size_t                  templates = 0;
+                size_t                  tableBytes = 0;     // heap used by the lookup tables and templates
+                std::array<uint32_t, LANGUAGE_COUNT> missing{};    // tags without text per language
+                size_t                  memoryBudget = 0;   // see SetMemoryBudget
+                double                  loadSeconds = 0;    // last LoadFiles, LoadFilesAsync or reload, start to publish
+                double                  buildSeconds = 0;   // building the current tables
+
+                size_t GetHeapBytes() const { return total.GetHeapBytes() + tableBytes; }
+            };
+
+            Localization();
+            ~Localization();
+
             void            LoadFiles(std::initializer_list<std::filesystem::path> paths);  // files will be added to a map, where keys are file names and values are LocFile objects
+            void            LoadFiles(std::span<const std::filesystem::path> paths);        // files are opened and parsed in parallel
+
+            // loads the files on a worker thread and returns right away. files become visible
+            // to lookups as they are loaded, see PendingPolicy for tags that aren't there yet
+            LoadHandle      LoadFilesAsync(std::vector<std::filesystem::path> paths);
+
             void            UnloadFiles(std::initializer_list<String> fileNames);
             void            UnloadFilesAll();
 
             void            CreateFileIndex(std::initializer_list<String> fileNames);  // parses requested files and creates index for tags to make searching quicker
             void            LoadFileIntoMap(const String& fileName, std::unordered_map<String, String>& map);   // loads a file into a provided tag-text map
             
-            String          GetStrByTag(const String& tag) const;
+            String          GetStrByTag(const String& tag) const;   // for dynamic tags, hashes the tag on every call
+            String          GetStrByTag(TagKey key) const;
+            std::string_view GetStrView(TagKey key) const;          // no copy, valid until files are loaded, unloaded or reloaded (or use Read)
+
+            // GetStrView for many tags at once (out has to be at least as long), faster than one by one:
+            // all keys are hashed and their table slots prefetched before any of them is resolved
+            void            GetStrViews(std::span<const TagKey> keys, std::span<std::string_view> out) const;
+            void            GetStrViews(std::span<const std::string_view> tags, std::span<std::string_view> out) const;
+
+            // text of a variation ("mult"_tag for [en.mult]), the default variation is used where it's missing.
+            // fallbacks are resolved when files are loaded, so this costs the same as the default variation
+            String          GetStrByTag(TagKey key, TagKey var) const;
+            std::string_view GetStrView(TagKey key, TagKey var) const;
+
+            // formats text of a tag in the current language, resolving inserts
+            // arguments go into {} slots in order of appearance (including slots of inserted tags),
+            // missing ones are replaced with MISSING_ARG
+            template<typename OutIt, typename... Args>
+            OutIt           FormatTo(OutIt out, TagKey key, const Args&... args) const;
+            template<typename... Args>
+            size_t          FormatToN(std::span<char> buffer, TagKey key, const Args&... args) const;    // returns the full length, output is truncated to the buffer
+            template<typename... Args>
+            String          Format(TagKey key, const Args&... args) const;
             String          GetFileContents(const String& fileName);
 
             uint16_t        GetLoadedFilesNum() const;
+            bool            HasTag(TagKey key) const;   // loaded already, in any language
+            bool            IsLoading() const;          // LoadFilesAsync is running
+
+            // applies to GetStrByTag, GetStrView and FormatTo. never wait while holding a ReadHandle,
+            // the loader can't publish until it's gone
+            void            SetPendingPolicy(PendingPolicy policy);
 
             void            SetLanguage(Language lang);
             static Language GetLanguage();
 
+            void            SetLoadThreads(size_t count);   // max threads used by LoadFiles, 0 to use all cores
+
+            // reloads loaded files when they change on disk, only changed entries of .ltf files are parsed again.
+            // lookups from other threads keep using the old text until the new one is ready
+            void            EnableHotReload(bool enable);
+
+            // .ltf files loaded from now on are shared with other processes that enable it: the first one
+            // publishes a compiled image of the file in shared memory, the rest map it instead of parsing.
+            // images are rebuilt when the .ltf changes (its size and write time are stored in them), and
+            // removed when the process that published one unloads it. a process that finds an image being
+            // published parses the file itself rather than waiting
+            void            EnableSharedCache(bool enable);
+
+            // heap the text of loaded files may take, 0 for no limit (the default: every .ltf is parsed into a map).
+            // .ltf files that don't fit are indexed instead: compiled into an .ltfb image in imageDir (the temp
+            // dir by default) and read from its mapping, so their text only takes memory while the OS keeps
+            // its pages in. files are moved between the two when the budget or the loaded files change, and
+            // on RebalanceMemory: the most looked up indexed files are parsed into maps while they fit, the
+            // least looked up maps are indexed while the budget is exceeded. lookup tables aren't counted,
+            // they cost the same either way. files move whole: the tables point straight into an image's
+            // mapping, so its hot strings are as fast as a map's while their pages stay in and the OS
+            // evicts the cold ones, a cache of hot strings would only copy them
+            void            SetMemoryBudget(size_t bytes, std::filesystem::path imageDir = {});
+            void            RebalanceMemory();
+
+            // walks every loaded entry, meant for tools and capacity planning rather than every frame
+            Stats           GetStats() const;
+            void            LogStats() const;   // GetStats through lg::Info, a line per file and the totals
+
+            class ReadHandle;
+            ReadHandle      Read() const;   // see ReadHandle
+
         private:
             struct LocFile
             {
-                file::File  m_file;
-                bool        m_indexed;
-                std::unordered_map<String, uint32_t> m_tagIndex;
+                std::filesystem::path   m_path;                 // normalized, as the watcher reports it
+                file::LtfFile           m_file;
+                file::LtfBinFile        m_binFile;
+                bool                    m_compiled = false;     // .ltfb files (and .ltf images) are queried directly, .ltf are parsed into a map
+                bool                    m_indexed = false;      // an .ltf image made because of the memory budget
+                size_t                  m_heapBytes = 0;        // of the map, for the budget
+
+                mutable std::atomic<uint64_t>   m_lookups = 0;  // sampled, see m_CountLookup
+            };
+
+            // where the text of a tag lives
+            struct TagRef
+            {
+                const LocFile*                  file = nullptr;
+                const file::itrn::MultiStr*     str = nullptr;      // for .ltf files
+                uint32_t                        entry = 0;          // for .ltfb files
+                std::string_view                tag;                // to tell apart tags with the same hash
+            };
+
+            struct KeyHash
+            {
+                size_t operator()(uint64_t hash) const { return static_cast<size_t>(hash); }    // already a hash
+            };
+
+            static constexpr uint32_t NO_TEMPLATE = 0xFFFFFFFF;
+            static constexpr size_t MAX_TEMPLATE_OPS = 4096;        // per template, after references are expanded
+            static constexpr uint32_t LOOKUP_SAMPLE = 64;           // every n-th lookup of a thread is counted for its file
+            static constexpr double DEFAULT_MAP_COST = 2.5;         // heap of a map per byte of .ltf, until enough maps were measured
+            static constexpr size_t MIN_MAP_COST_BYTES = 1 << 20;
+
+            // text of every tag (by tag index) in one language / variation, with the fallbacks already applied:
+            // text missing in a variation is the default variation's, text missing there is MISSING_TRANSLATION
+            struct StringTable
+            {
+                Language                        lan = Language::NONE;
+                String                          var;
+                std::vector<std::string_view>   strings;
+                std::vector<uint32_t>           templates;      // template of every tag, or NO_TEMPLATE
+            };
+
+            // text of a tag in one language / variation compiled for formatting
+            struct Template
+            {
+                enum class State : uint8_t { RAW, COMPILING, READY };
+
+                std::string_view    tag;
+                std::string_view    text;
+                Language            lan = Language::NONE;
+                State               state = State::RAW;
+                uint16_t            argCount = 0;       // including arguments of referenced templates
+                uint32_t            firstOp = 0, opCount = 0;       // references expanded, only LITERAL and ARG ops
+            };
+
+            struct TemplateKey
+            {
+                uint64_t    tag;
+                Language    lan;
+                uint64_t    var;        // hash of the variation, 0 for default
+
+                friend bool operator==(const TemplateKey&, const TemplateKey&) = default;
+            };
+
+            struct TemplateKeyHash
+            {
+                size_t operator()(const TemplateKey& key) const
+                {
+                    return static_cast<size_t>(util::Mix64(key.tag ^ (key.var * 31) ^ static_cast<uint64_t>(key.lan)));
+                }
+            };
+
+            // everything lookups use, built from the loaded files and never changed after it's published
+            struct Tables
+            {
+                std::vector<std::shared_ptr<const LocFile>>             files;          // keep the text alive
+                std::vector<TagRef>                                     tags;           // by tag index
+                util::FlatMap<uint64_t, uint32_t, KeyHash>              tagIndices;     // tag hash -> tag index
+
+                // switching language (or variation) is an index into tableOf
+                std::vector<StringTable>                                strings;
+                util::FlatMap<uint64_t, uint32_t, KeyHash>              variationIds;   // variation hash -> id, 0 is the default variation
+                std::vector<int32_t>                                    tableOf;        // [variation id * LANGUAGE_COUNT + language] -> table
+                                                                                        // (the default variation's if there's none), -1 if none
+                std::array<uint32_t, LANGUAGE_COUNT>                    missing{};      // tags without text per language
+                size_t                                                  fallbacks = 0;  // variation text taken from the default variation
+
+                std::vector<Template>                                   templates;
+                std::vector<file::itrn::InsertOp>                       templateOps;    // ops of all templates, back to back
+                util::FlatMap<TemplateKey, uint32_t, TemplateKeyHash>   templateIds;
+
+                double                                                  buildSeconds = 0;
+            };
+
+            using LocFileMap = util::FlatMap<String, std::shared_ptr<LocFile>>;
+
+        public:
+            // progress of LoadFilesAsync, can be copied and outlive the call
+            class LoadHandle
+            {
+            public:
+                bool    IsDone() const          { return m_state->finished.load(); }
+                void    Wait() const;
+                size_t  GetFileCount() const    { return m_state->total; }
+                size_t  GetDoneCount() const    { return m_state->done.load(); }   // loaded or failed
+                size_t  GetFailedCount() const  { return m_state->failed.load(); }
+
+            private:
+                friend class Localization;
+
+                struct State
+                {
+                    size_t                  total = 0;
+                    std::atomic<size_t>     done = 0;
+                    std::atomic<size_t>     failed = 0;
+                    std::atomic<bool>       finished = false;
+                };
+
+                explicit LoadHandle(std::shared_ptr<State> state) : m_state(std::move(state)) {}
+
+                std::shared_ptr<State> m_state;
+            };
+
+            // the loaded text as it was when the handle was taken: views from it stay valid while it lives,
+            // even if files are loaded, unloaded or reloaded meanwhile. taking one doesn't lock or wait,
+            // but writers wait until it's gone, so keep it short (a frame, not a level).
+            // it belongs to the thread that took it
+            class ReadHandle
+            {
+            public:
+                std::string_view GetStrView(TagKey key) const { return m_Lookup(*m_tables, key); }
+                std::string_view GetStrView(TagKey key, TagKey var) const { return m_Lookup(*m_tables, key, &var); }
+                void GetStrViews(std::span<const TagKey> keys, std::span<std::string_view> out) const { m_LookupBatch(*m_tables, keys, out); }
+
+                template<typename OutIt, typename... Args>
+                OutIt FormatTo(OutIt out, TagKey key, const Args&... args) const { return m_Format(*m_tables, out, key, args...); }
+
+            private:
+                friend class Localization;
+                explicit ReadHandle(const Localization& loc) : m_tables(loc.m_tables) {}
+
+                util::Rcu<Tables>::ReadGuard m_tables;
             };
 
         private:
-            void m_ParseFile();
+            // an .ltf is indexed through an image in imageDir if it isn't empty, and parsed into a map if that fails
+            static void m_LoadFile(LocFile& locFile, const std::filesystem::path& path, size_t threads, bool shared,
+                const std::filesystem::path& imageDir, const LocFile* previous = nullptr);
+            void m_ReloadFile(const std::filesystem::path& path);
+            void m_Publish();
+            void m_LoadAsync(std::stop_token stop, const std::vector<std::filesystem::path>& paths, const std::vector<String>& names,
+                const std::vector<std::filesystem::path>& imageDirs, size_t threads, bool shared, LoadHandle::State& state);
+
+            // memory budget, callers hold m_writeMutex
+            std::vector<std::filesystem::path> m_PlanImageDirs(std::span<const std::filesystem::path> paths) const;  // empty for files that fit as maps
+            bool m_Rebalance();     // true if a file was moved, the tables have to be published then
+            double m_MapCost() const;
+            static size_t m_FileHeapBytes(const LocFile& locFile);
+            static void m_CountLookup(const Tables& tables, uint32_t tag);
+            bool m_IsPending(TagKey key) const;    // true if the placeholder should be returned for the tag
+
+            static std::unique_ptr<const Tables> m_BuildTables(const LocFileMap& files);
+            static void m_AddTag(Tables& tables, const LocFile& file, std::string_view tag, const file::itrn::MultiStr* str, uint32_t entry);
+            static void m_BuildStringTables(Tables& tables);
+            static const StringTable* m_TableOf(const Tables& tables, const TagKey* var);     // of the current language
+            static std::string_view m_Lookup(const Tables& tables, TagKey key, const TagKey* var = nullptr);
+            static void m_LookupBatch(const Tables& tables, std::span<const TagKey> keys, std::span<std::string_view> out);
+            void m_ReportMissing(const Tables& tables);
+            static size_t m_TableBytes(const Tables& tables);
+
+            static void m_BuildTemplates(Tables& tables);
+            static void m_AddTemplate(Tables& tables, std::string_view tag, Language lan, std::string_view var, std::string_view text);
+            static void m_CompileTemplates(Tables& tables);
+
+            template<typename OutIt, typename... Args>
+            static OutIt m_Format(const Tables& tables, OutIt out, TagKey key, const Args&... args);
+            template<typename OutIt>
+            static OutIt m_RunTemplate(const Tables& tables, OutIt out, uint32_t index, std::format_args args, size_t argCount);
 
 
         private:
-            static Language                     m_gameLang;
-            std::unordered_map<String, LocFile> m_loadedLocFiles;
+            static std::atomic<Language>                        m_gameLang;
+            size_t                                              m_loadThreads = 0;
+            bool                                                m_sharedCache = false;
+            std::atomic<size_t>                                 m_memoryBudget = 0;     // written under m_writeMutex, GetStats reads it without
+            std::filesystem::path                               m_imageDir;
+
+            // writers (loading, unloading, reloads) take m_writeMutex and publish a new m_tables,
+            // readers only enter a read section of m_tables and never wait for writers
+            std::mutex                                          m_writeMutex;
+            LocFileMap                                          m_loadedLocFiles;
+            util::Rcu<Tables>                                   m_tables;
+            std::array<uint32_t, LANGUAGE_COUNT>                m_reportedMissing{};    // so the same numbers aren't logged after every reload
+            std::atomic<double>                                 m_loadSeconds = 0;      // see Stats
+
+            // LoadFilesAsync
+            std::vector<String>                                 m_pendingNames;     // files that are being loaded, to catch duplicates
+            std::vector<std::jthread>                           m_loaders;
+            std::atomic<size_t>                                 m_pendingLoads = 0;
+            std::atomic<PendingPolicy>                          m_pendingPolicy = PendingPolicy::PLACEHOLDER;
+
+            std::unique_ptr<file::FileWatcher>                  m_watcher;      // last, stops before the rest is destroyed
         };
+    
+        // -----------------------------
+
+        template<typename OutIt, typename... Args>
+        OutIt Localization::FormatTo(OutIt out, TagKey key, const Args&... args) const
+        {
+            if (m_IsPending(key)) return std::copy(PENDING_TEXT.begin(), PENDING_TEXT.end(), out);
+
+            // read until formatting is done, so a reload can't free the text under us
+            const auto tables = m_tables.Read();
+            return m_Format(*tables, out, key, args...);
+        }
+
+        template<typename OutIt, typename... Args>
+        OutIt Localization::m_Format(const Tables& tables, OutIt out, TagKey key, const Args&... args)
+        {
+            auto it = tables.tagIndices.find(key.GetHash());
+            const StringTable* table = m_TableOf(tables, nullptr);
+            const uint32_t tmpl = it != tables.tagIndices.end() && table ? table->templates[it->second] : NO_TEMPLATE;
+            if (it != tables.tagIndices.end()) m_CountLookup(tables, it->second);
+            if (tmpl == NO_TEMPLATE)
+                return std::copy(file::itrn::MISSING_TRANSLATION.begin(), file::itrn::MISSING_TRANSLATION.end(), out);
+
+            return m_RunTemplate(tables, out, tmpl, std::make_format_args(args...), sizeof...(Args));
+        }
+
+        template<typename... Args>
+        size_t Localization::FormatToN(std::span<char> buffer, TagKey key, const Args&... args) const
+        {
+            itrn::BufferIt it{ buffer.data(), buffer.data() + buffer.size() };
+            return FormatTo(it, key, args...).written;
+        }
+
+        template<typename... Args>
+        String Localization::Format(TagKey key, const Args&... args) const
+        {
+            String str;
+            FormatTo(std::back_inserter(str), key, args...);
+            return str;
+        }
+
+        template<typename OutIt>
+        OutIt Localization::m_RunTemplate(const Tables& tables, OutIt out, uint32_t index, std::format_args args, size_t argCount)
+        {
+            using namespace file::itrn;
+
+            const Template& tmpl = tables.templates[index];
+            for (uint32_t i = tmpl.firstOp; i < tmpl.firstOp + tmpl.opCount; ++i)
+            {
+                const InsertOp& op = tables.templateOps[i];
+                switch (op.type)
+                {
+                case InsertOpType::LITERAL:
+                    out = std::copy(op.text.begin(), op.text.end(), out);
+                    break;
+
+                case InsertOpType::ARG:
+                {
+                    if (op.arg < argCount && op.arg < itrn::ARG_FORMATS.size())
+                        out = std::vformat_to(out, std::string_view(itrn::ARG_FORMATS[op.arg].data()), args);
+                    else
+                        out = std::copy(MISSING_ARG.begin(), MISSING_ARG.end(), out);
+                    break;
+                }
+
+                case InsertOpType::REF:
+                    break;      // expanded when the tables are built, never left in a template
+                }
+            }
+            return out;
+        }
     }
 }
\ No newline at end of file
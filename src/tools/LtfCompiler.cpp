@@ -0,0 +1,81 @@
+// ltfc: compiles .ltf files into .ltfb (see Ltf.h for the format)
+// usage: ltfc [--languages <codes>] [--compress] <input.ltf> [output.ltfb]
+//        ltfc [--languages <codes>] --check <input.ltf>
+// if no output is given, the input path with .ltfb extension is used.
+// --languages enables headers for more languages, comma separated (ko,it), see lang::SetHeaderLanguages
+// --compress stores the text in compressed blocks, which are decoded on demand when loaded
+// --check only looks for errors, the file is streamed so it works for files of any size
+
+#include "../core/Config.h"
+#include "../core/Logging.h"
+#include "../core/Ltf.h"
+
+#include <filesystem>
+#include <format>
+#include <chrono>
+#include <string_view>
+#include <algorithm>
+
+int main(int argc, char** argv)
+{
+    conf::Init();
+
+    if (argc > 2 && std::string_view(argv[1]) == "--languages")
+    {
+        lang::LanguageSet languages = lang::GetHeaderLanguages();
+        for (std::string_view codes = argv[2]; !codes.empty();)
+        {
+            const std::string_view code = codes.substr(0, codes.find(','));
+            codes.remove_prefix(std::min(codes.size(), code.size() + 1));
+
+            const lang::Language lan = lang::GetLanguageCodeEnum(code);
+            if (lan == lang::Language::NONE)
+            {
+                lg::Error(std::format("Unknown language code: {}", code));
+                return 1;
+            }
+            languages.set(static_cast<size_t>(lan));
+        }
+        lang::SetHeaderLanguages(languages);
+        argv += 2;
+        argc -= 2;
+    }
+
+    const bool check = argc > 1 && std::string_view(argv[1]) == "--check";
+    const bool compress = argc > 1 && std::string_view(argv[1]) == "--compress";
+    if (compress)
+    {
+        ++argv;
+        --argc;
+    }
+
+    if (argc < 2 || argc > 3 || (check && argc != 3))
+    {
+        lg::Output("usage: ltfc [--languages <codes>] [--compress] <input.ltf> [output.ltfb]\n       ltfc [--languages <codes>] --check <input.ltf>\n");
+        return 1;
+    }
+
+    if (check)
+    {
+        std::filesystem::path src = argv[2];
+        auto begin = std::chrono::steady_clock::now();
+        if (!file::CheckLtf(src)) return 1;
+        auto end = std::chrono::steady_clock::now();
+
+        lg::Info(std::format("Checked {} in {} ms, no errors", src.string(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()));
+        return 0;
+    }
+
+    std::filesystem::path src = argv[1];
+    std::filesystem::path dst = argc == 3 ? std::filesystem::path(argv[2]) : std::filesystem::path(src).replace_extension(".ltfb");
+
+    auto begin = std::chrono::steady_clock::now();
+    if (!file::CompileLtfb(src, dst, compress ? file::itrn::LTFB_DEFAULT_BLOCK_SIZE : 0)) return 1;
+    auto end = std::chrono::steady_clock::now();
+
+    lg::Info(std::format("Compiled {} -> {} in {} ms ({} -> {} bytes)", src.string(), dst.string(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count(),
+        std::filesystem::file_size(src), std::filesystem::file_size(dst)));
+    return 0;
+}